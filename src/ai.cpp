@@ -17,76 +17,303 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+//enemies plan their moves on their own cog: at the end of each frame the main
+//cog publishes a snapshot of the field and of the players, and the ai cog
+//answers with a joypad-style command for every enemy. Add -DAI_SAME_COG to
+//the CFLAGS to plan on the main cog instead, right after publishing.
+#ifndef AI_SAME_COG
+
+#include <propeller.h>
+
+u32 aiStack[AI_STACK_LONGS];
+
+#endif
+
+uint8_t AiTileClass(uint8_t tile) {
+    switch (tile) {
+        case TILE_BG:
+            return AI_CELL_BG;
+        case TILE_LADDER:
+            return AI_CELL_LADDER;
+        case TILE_ROPE:
+            return AI_CELL_ROPE;
+        case TILE_BREAKABLE:
+            return AI_CELL_BREAKABLE;
+        case TILE_UNBREAKABLE:
+            return AI_CELL_UNBREAKABLE;
+        case TILE_BREAKABLE_FAKE:
+            return AI_CELL_FAKE;
+        case TILE_BG_STEP_ON:
+            return AI_CELL_STEP_ON;
+    }
+    if (tile >= TILE_DESTROY1 && tile <= TILE_DESTROY5)
+        return AI_CELL_DESTROY;
+    return AI_CELL_OTHER;
+}
+
+//main cog side
+
+//keeps the world being filled in sync with vram, see SetFieldTile
+void SetAiCell(uint8_t x, uint8_t y, uint8_t tile) {
+    u16 i = (y * VRAM_TILES_H) + x;
+    AiWorld *world = &aiMailbox.world[aiMailbox.published ^ 1];
+    u8 *cell = &world->cells[i >> 1];
+    u8 kind = AiTileClass(tile);
+
+    //gold blinking and the steps of a dig within a class don't change a path
+    if (((*cell >> ((i & 1) << 2)) & 0x0f) == kind)
+        return;
+
+    if (i & 1) {
+        *cell = (*cell & 0x0f) | (kind << 4);
+    } else {
+        *cell = (*cell & 0xf0) | kind;
+    }
+    world->epoch++;
+}
+
+void StartAiCog() {
+#ifndef AI_SAME_COG
+    PROFILE_FILL_STACK(aiStack);
+    cogstart(AiCog, NULL, aiStack, sizeof(aiStack));
+#endif
+}
+
+//called once the level is unpacked, publishes the first world of the level
+void InitAi() {
+    AiWorld *world;
+
+    //wait for the ai cog to be done with the world of the previous level
+    while (aiMailbox.done != aiMailbox.sequence)
+        ;
+
+    world = &aiMailbox.world[aiMailbox.published ^ 1];
+    for (u16 i = 0; i < VRAM_TILES_H * VRAM_TILES_V; i += 2) {
+        world->cells[i >> 1] = AiTileClass(vram[i]) | (AiTileClass(vram[i + 1]) << 4);
+    }
+    world->level++;
+    world->epoch++;
+
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        player.aiButtons[id] = 0;
+    }
+    aiReceived = aiMailbox.done;
+
+    PublishAiWorld();
+}
+
+//called at the end of each frame, skipped while the ai cog is still planning
+//on the previous world: enemies then keep their last command
+void PublishAiWorld() {
+    u8 back = aiMailbox.published ^ 1;
+    AiWorld *world = &aiMailbox.world[back];
+
+    if (aiMailbox.done != aiMailbox.sequence)
+        return;
+
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        world->x[id] = player.x[id] >> 8;
+        world->y[id] = player.y[id] >> 8;
+        world->action[id] = player.action[id];
+        world->dir[id] = player.dir[id];
+        world->active[id] = player.active[id];
+    }
+    world->seed = rng.seed;
+
+    COMPILER_BARRIER();
+    aiMailbox.published = back;
+    aiMailbox.sequence++;
+
+    //the ai cog only reads the published world, bring the other one up to date
+    memcpy(aiMailbox.world[back ^ 1].cells, world->cells, AI_CELLS_SIZE);
+    aiMailbox.world[back ^ 1].level = world->level;
+    aiMailbox.world[back ^ 1].epoch = world->epoch;
+    aiMailbox.world[back ^ 1].seed = world->seed;
+
+#ifdef AI_SAME_COG
+    AiStep();
+#endif
+}
+
+//called at the start of each frame, before the enemies move
+void ReceiveAiCommands() {
+    if (aiMailbox.done == aiReceived)
+        return;
+
+    for (u8 id = 0; id < SPR_INDEX_PLAYER; id++) {
+        player.aiButtons[id] = aiMailbox.buttons[id];
+        if (aiMailbox.dir[id] != 0) {
+            player.dir[id] = aiMailbox.dir[id];
+        }
+    }
+    aiReceived = aiMailbox.done;
+}
+
+//ai cog side, only reads the published world and writes the commands
+
+void AiCog(void *par) {
+    while (1) {
+        while (aiMailbox.done == aiMailbox.sequence)
+            ;
+        AiStep();
+    }
+}
+
+void AiStep() {
+    u16 sequence = aiMailbox.sequence;
+    u16 buttons;
+
+    ai.world = &aiMailbox.world[aiMailbox.published];
+
+    if (ai.world->level != ai.level) {
+        ai.level = ai.world->level;
+        for (u8 id = 0; id < SPR_INDEX_PLAYER; id++) {
+            ai.target[id] = 0;
+            ai.lastAction[id] = 0;
+            ai.stuckDelay[id] = 0;
+        }
+        ai.pathCount = 0;
+    }
+    if (ai.world->seed != ai.seed || ai.random[0] == 0) {
+        ai.seed = ai.world->seed;
+        for (u8 id = 0; id < SPR_INDEX_PLAYER; id++) {
+            ai.random[id] = RandomSeed(ai.seed, RANDOM_AI + id);
+        }
+    }
+
+    for (u8 id = 0; id < SPR_INDEX_PLAYER; id++) {
+        buttons = 0;
+        ai.dir[id] = ai.world->dir[id];
+        if (ai.world->active[id] && IS_ACTION_COMMANDED(ai.world->action[id])) {
+            PROFILE_BEGIN(PROFILE_AI);
+            buttons = Ai(id);
+            PROFILE_END(PROFILE_AI);
+        } else if (ai.world->active[id]) {
+            //falling, trapped or respawning, it would ignore the command:
+            //the plan is kept and goes on once it can move
+            ai.skipped++;
+        }
+        aiMailbox.buttons[id] = buttons;
+        aiMailbox.dir[id] = (ai.dir[id] != ai.world->dir[id] ? ai.dir[id] : 0);
+    }
+
+    COMPILER_BARRIER();
+    aiMailbox.done = sequence;
+}
+
+//class of the tile at the feet of a sprite, as GetTileAtFeet
+uint8_t AiCellAtFeet(uint8_t x, uint8_t y) {
+    u8 row = TILE_ROW(y + (TILE_HEIGHT - 1));
+    u16 i;
+
+    if (row >= VRAM_TILES_V)
+        return AI_CELL_OTHER;
+    i = (row * VRAM_TILES_H) + ((x + 4) >> 3);
+    return AI_CELL_AT(ai.world->cells, i);
+}
+
+bool IsAiCellSolid(uint8_t cell, uint8_t id) {
+    if (cell == AI_CELL_BREAKABLE || cell == AI_CELL_UNBREAKABLE || cell == AI_CELL_LADDER || cell == AI_CELL_STEP_ON)
+        return true;
+
+    if (cell == AI_CELL_DESTROY) {
+        //check if there's an enemy in the hole so we can step on it's head
+        u8 srcX = (ai.world->x[id] + 4) >> 3;
+        u8 srcY = TILE_ROW(ai.world->y[id]);
+
+        for (u8 i = 0; i < SPR_INDEX_PLAYER; i++) {
+            if (ai.world->active[i] && srcX == (ai.world->x[i] >> 3) && (srcY + 1) == TILE_ROW(ai.world->y[i])) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool IsAiCellBlocking(uint8_t cell) {
+    return AI_CELL_BLOCKING(cell);
+}
+
 uint16_t Ai(uint8_t id) {
 
-    u8 srcX = (player[id].x >> 8);
-    u8 srcY = (player[id].y >> 8);
-    u8 destX = (player[SPR_INDEX_PLAYER].x >> 8);
-    u8 destY = (player[SPR_INDEX_PLAYER].y >> 8);
+    u8 srcX = ai.world->x[id];
+    u8 srcY = ai.world->y[id];
+    u8 destX = ai.world->x[SPR_INDEX_PLAYER];
+    u8 destY = ai.world->y[SPR_INDEX_PLAYER];
     u8 action = 0;
 
-    if (player[id].stuckDelay > 0) {
-        player[id].stuckDelay--;
+    if (ai.stuckDelay[id] > 0) {
+        ai.stuckDelay[id]--;
         return 0;
     }
 
-    if (player[id].action == ACTION_CLIMB) {
+    if (ai.world->action[id] == ACTION_CLIMB) {
+        //insure enemies doesn't reach the top of the screen
+        if (srcY <= 4 && ai.lastAction[id] == AI_ACTION_CLIMB_UP) {
+            ai.lastAction[id] = AI_ACTION_CLIMB_DOWN;
+        }
+
         //if we were already climbing continue to destination
         //unless the player is at same level
         if (srcY != destY) {
-            if (player[id].lastAiAction == AI_ACTION_CLIMB_UP) {
+            if (ai.lastAction[id] == AI_ACTION_CLIMB_UP) {
                 return BTN_UP;
-            } else if (player[id].lastAiAction == AI_ACTION_CLIMB_DOWN) {
+            } else if (ai.lastAction[id] == AI_ACTION_CLIMB_DOWN) {
                 return BTN_DOWN;
             }
         } else {
-            player[id].aiTarget = 0;
+            ai.target[id] = 0;
         }
     }
 
-    if (player[id].lastAiAction == AI_ACTION_MOVE && player[id].aiTarget != 0) {
+    if (ai.lastAction[id] == AI_ACTION_MOVE && ai.target[id] != 0) {
 
-        if ((srcX >= (player[id].aiTarget & 0xfff8) && player[id].dir == 1)
-            || (srcX <= (player[id].aiTarget & 0xfff8) && player[id].dir == -1)) {
-            player[id].aiTarget = 0;
+        if ((srcX >= (ai.target[id] & 0xfff8) && ai.dir[id] == 1)
+            || (srcX <= (ai.target[id] & 0xfff8) && ai.dir[id] == -1)) {
+            ai.target[id] = 0;
         } else {
-            action = player[id].lastAiAction;
+            action = ai.lastAction[id];
         }
     }
 
-    if (player[id].aiTarget == 0) {
+    if (ai.target[id] == 0) {
 
         if (srcX < destX) {
-            player[id].dir = 1;
+            ai.dir[id] = 1;
         } else {
-            player[id].dir = -1;
+            ai.dir[id] = -1;
         }
 
-        action = findPath(id, srcX, srcY, destX, destY, player[id].dir);
+        PROFILE_BEGIN(PROFILE_FIND_PATH);
+        action = CachedPath(id, srcX, srcY, destX, destY, ai.dir[id]);
+        PROFILE_END(PROFILE_FIND_PATH);
 
         if (action == AI_NO_PATH) {
             //no path in this direction, try the other way
 
-            action = findPath(id, srcX, srcY, destX, destY, -player[id].dir);
+            PROFILE_BEGIN(PROFILE_FIND_PATH);
+            action = CachedPath(id, srcX, srcY, destX, destY, -ai.dir[id]);
+            PROFILE_END(PROFILE_FIND_PATH);
             if (action == AI_NO_PATH) {
                 //no way to get out, this guy is stuck
                 //retry in some random # of frames
                 //to avoid eating all the cpu trying to find an exit path
-                player[id].stuckDelay = (rand() % 100) + 5;
+                ai.stuckDelay[id] = RandomRange(&ai.random[id], 100) + 5;
 
             } else {
-                player[id].dir = -player[id].dir;
+                ai.dir[id] = -ai.dir[id];
             }
         }
 
-        player[id].lastAiAction = action;
+        ai.lastAction[id] = action;
     }
 
     //reverse direction if we hit a wall
     //TODO
 
     if (action == AI_ACTION_MOVE) {
-        if (player[id].dir == 1) {
+        if (ai.dir[id] == 1) {
             return BTN_RIGHT;
         } else {
             return BTN_LEFT;
@@ -103,9 +330,52 @@ uint16_t Ai(uint8_t id) {
     return 0;
 }
 
+//findPath, answered from the paths found since the world last changed: a
+//stuck enemy retrying or enemies queued on the same ladder don't scan again.
+//Falling from a rope depends on where the other enemies are, it is not kept
+uint8_t CachedPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t destY, int8_t dir) {
+    u16 epoch = ai.world->epoch;
+    bool climbingUp = (ai.lastAction[id] == AI_ACTION_CLIMB_UP);
+    u8 destCol = destX & 0xf8;
+    AiPath *path;
+    u8 action;
+
+    if (ai.world->action[id] == ACTION_CLING && srcY < destY)
+        return findPath(id, srcX, srcY, destX, destY, dir);
+
+    for (u8 i = 0; i < ai.pathCount; i++) {
+        path = &ai.paths[i];
+        if (path->epoch == epoch && path->srcX == srcX && path->srcY == srcY && path->destX == destCol
+            && path->destY == destY && path->dir == dir && path->climbingUp == climbingUp) {
+            ai.target[id] = path->target;
+            ai.pathHits++;
+            return path->action;
+        }
+    }
+
+    action = findPath(id, srcX, srcY, destX, destY, dir);
+
+    path = &ai.paths[ai.pathNext];
+    path->epoch = epoch;
+    path->srcX = srcX;
+    path->srcY = srcY;
+    path->destX = destCol;
+    path->destY = destY;
+    path->dir = dir;
+    path->climbingUp = climbingUp;
+    path->action = action;
+    path->target = ai.target[id];
+    ai.pathNext = (ai.pathNext + 1) & (AI_PATH_CACHE_SIZE - 1);
+    if (ai.pathCount < AI_PATH_CACHE_SIZE) {
+        ai.pathCount++;
+    }
+    return action;
+}
+
 uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t destY, int8_t dir) {
     s16 loc = 0;
-    player[id].aiTarget = 0;
+    ai.target[id] = 0;
+    ai.searches++;
 
     //check if target is at same altitude and right ahead
     if (srcY == destY) {
@@ -119,7 +389,7 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
 
             if (loc != srcX) {
                 //move toward ladder
-                player[id].aiTarget = loc;
+                ai.target[id] = loc;
                 return AI_ACTION_MOVE;
             } else {
                 //we are right at ladder base, climb up
@@ -131,7 +401,7 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
             if (loc != -1) {
                 if (loc != srcX) {
                     //move toward toward ladder (walk or rope)
-                    player[id].aiTarget = loc;
+                    ai.target[id] = loc;
                     return AI_ACTION_MOVE;
                 } else {
                     //climb ladder
@@ -142,7 +412,7 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
                 loc = findCliffOnPath(srcX, srcY, dir);
                 if (loc != -1) {
                     //move toward cliff
-                    player[id].aiTarget = loc;
+                    ai.target[id] = loc;
                     return AI_ACTION_MOVE;
                 } else {
                     return AI_NO_PATH;
@@ -160,7 +430,7 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
         if (loc != -1) {
             if (loc != srcX) {
                 //move toward toward ladder (walk or rope)
-                player[id].aiTarget = loc;
+                ai.target[id] = loc;
                 return AI_ACTION_MOVE;
             } else {
                 //climb ladder
@@ -178,26 +448,26 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
     if (srcY < destY) {
 
         //if on rope, check if we can reach the player by falling
-        if (player[id].action == ACTION_CLING) {
+        if (ai.world->action[id] == ACTION_CLING) {
             u8 y = destY;
             s8 c;
 
             while (y < FIELD_HEIGHT * TILE_HEIGHT) {
-                if (IsTileSolid(GetTileAtFeet(srcX, y + TILE_HEIGHT), id)) {
+                if (IsAiCellSolid(AiCellAtFeet(srcX, y + TILE_HEIGHT), id)) {
                     if (y == destY) {
-                        c = findPathTo(srcX, y, destX, player[id].dir);
+                        c = findPathTo(srcX, y, destX, ai.dir[id]);
                         if (c != -1) {
                             if ((srcX >> 3) == (destX >> 3)) {	// && !IsTileSolid(GetTileAt(srcX,srcY+1))){
-                                player[id].aiTarget = 0;
+                                ai.target[id] = 0;
                                 return AI_ACTION_FALL;
                             } else {
                                 return AI_ACTION_MOVE;
                             }
                         } else {
-                            c = findPathTo(srcX, y, destX, -player[id].dir);
+                            c = findPathTo(srcX, y, destX, -ai.dir[id]);
                             if (c != -1) {
-                                player[id].dir = -player[id].dir;
-                                player[id].aiTarget = 0;
+                                ai.dir[id] = -ai.dir[id];
+                                ai.target[id] = 0;
                                 return AI_ACTION_FALL;
                             }
                         }
@@ -214,7 +484,7 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
 
         } else {
 
-            if (player[id].lastAiAction != AI_ACTION_CLIMB_UP) {
+            if (ai.lastAction[id] != AI_ACTION_CLIMB_UP) {
 
                 //check to go down a ladder
                 loc = findLadderDownOnPath(srcX, srcY, dir);
@@ -222,7 +492,7 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
 
                     if (loc != srcX) {
                         //move toward toward ladder (walk or rope)
-                        player[id].aiTarget = loc;
+                        ai.target[id] = loc;
                         return AI_ACTION_MOVE;
                     } else {
                         //climb ladder
@@ -237,9 +507,9 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
             if (loc != -1) {
                 if (loc >= srcX && dir == 1) {
                     //move toward toward cliff (walk or rope or fake brick)
-                    player[id].aiTarget = loc + 5;
+                    ai.target[id] = loc + 5;
                 } else if (loc <= srcX && dir == -1) {
-                    player[id].aiTarget = loc - 5;
+                    ai.target[id] = loc - 5;
                 }
                 return AI_ACTION_MOVE;
             } else {
@@ -253,92 +523,133 @@ uint8_t findPath(uint8_t id, uint8_t srcX, uint8_t srcY, uint8_t destX, uint8_t
     return AI_NO_PATH; //no path in this direction
 }
 
+//the scans along a row below run from the fcache: the cells at the feet and
+//under them are read inline and walked a column at a time, without calls or
+//multiplies. Sprites never stand on the last vram row, AiCellAtFeet would
+//return AI_CELL_OTHER there.
+
+FCACHE
 int16_t findLadderUpOnPath(uint8_t x, uint8_t y, int8_t dir) {
 
-    u8 tile, tileUnder;
-    x &= 0xf8;
+    u8 cell, cellUnder;
+    u8 col = x >> 3;
+    u8 row = TILE_ROW(y + (TILE_HEIGHT - 1));
+    const u8 *cells = ai.world->cells;
+    u16 i;
+
+    if (row >= VRAM_TILES_V - 1)
+        return -1;
+    i = VRAM_ROW(row) + col;
 
     //try direct on X axis
-    while (x > 0 && x < VRAM_TILES_H * TILE_WIDTH) {
+    while (col > 0 && col < VRAM_TILES_H) {
 
-        tile = GetTileAtFeet(x, y);
-        tileUnder = GetTileAtFeet(x, y + TILE_HEIGHT);
+        cell = AI_CELL_AT(cells, i);
+        cellUnder = AI_CELL_AT(cells, i + VRAM_TILES_H);
 
-        if (tile == TILE_LADDER) {
-            return x;
-        } else if (tile == TILE_BREAKABLE || tile == TILE_UNBREAKABLE || (tileUnder == TILE_BG && tile != TILE_ROPE)) {
+        if (cell == AI_CELL_LADDER) {
+            return col << 3;
+        } else if (cell == AI_CELL_BREAKABLE || cell == AI_CELL_UNBREAKABLE || (cellUnder == AI_CELL_BG && cell != AI_CELL_ROPE)) {
             return -1; //dead end
         }
 
-        x += (dir * TILE_WIDTH);
+        col += dir;
+        i += dir;
     }
 
     return -1;
 }
 
+FCACHE
 int16_t findLadderDownOnPath(uint8_t x, uint8_t y, int8_t dir) {
 
-    u8 tile, tileUnder;
-    x &= 0xf8;
+    u8 cell, cellUnder;
+    u8 col = x >> 3;
+    u8 row = TILE_ROW(y + (TILE_HEIGHT - 1));
+    const u8 *cells = ai.world->cells;
+    u16 i;
+
+    if (row >= VRAM_TILES_V - 1)
+        return -1;
+    i = VRAM_ROW(row) + col;
 
     //try direct on X axis
-    while (x > 0 && x < VRAM_TILES_H * TILE_WIDTH) {
+    while (col > 0 && col < VRAM_TILES_H) {
 
-        tile = GetTileAtFeet(x, y);
-        tileUnder = GetTileAtFeet(x, y + TILE_HEIGHT);
+        cell = AI_CELL_AT(cells, i);
+        cellUnder = AI_CELL_AT(cells, i + VRAM_TILES_H);
 
-        if (tileUnder == TILE_LADDER) {
-            return x;
-        } else if (tileUnder == TILE_BG && tile != TILE_ROPE) {
+        if (cellUnder == AI_CELL_LADDER) {
+            return col << 3;
+        } else if (cellUnder == AI_CELL_BG && cell != AI_CELL_ROPE) {
             return -1; //dead end, blocked by a cliff
         }
 
-        x += (dir * TILE_WIDTH);
+        col += dir;
+        i += dir;
     }
 
     return -1;
 }
 
 //find a reachable cliff (or fake brick) on the path
+FCACHE
 int16_t findCliffOnPath(uint8_t x, uint8_t y, int8_t dir) {
 
-    u8 tile, tileUnder;
-    x &= 0xf8;
+    u8 cell, cellUnder;
+    u8 col = x >> 3;
+    u8 row = TILE_ROW(y + (TILE_HEIGHT - 1));
+    const u8 *cells = ai.world->cells;
+    u16 i;
+
+    if (row >= VRAM_TILES_V - 1)
+        return -1;
+    i = VRAM_ROW(row) + col;
 
     //try direct on X axis
-    while (x > 0 && x < VRAM_TILES_H * TILE_WIDTH) {
-        tile = GetTileAtFeet(x, y);
-        tileUnder = GetTileAtFeet(x, y + TILE_HEIGHT);
+    while (col > 0 && col < VRAM_TILES_H) {
+        cell = AI_CELL_AT(cells, i);
+        cellUnder = AI_CELL_AT(cells, i + VRAM_TILES_H);
 
-        if (IsTileBlocking(tile))
+        if (AI_CELL_BLOCKING(cell))
             return -1; //dead end, blocked by a wall
-        if (tileUnder == TILE_BG || tileUnder == TILE_BREAKABLE_FAKE)
-            return x;
-        x += (dir * TILE_WIDTH);
+        if (cellUnder == AI_CELL_BG || cellUnder == AI_CELL_FAKE)
+            return col << 3;
+        col += dir;
+        i += dir;
     }
 
     return -1;
 }
 
+FCACHE
 int16_t findPathTo(uint8_t srcX, uint8_t srcY, uint8_t destX, int8_t dir) {
 
-    u8 tile, tileUnder;
-    srcX &= 0xf8;
-    destX &= 0xf8;
+    u8 cell, cellUnder;
+    u8 col = srcX >> 3;
+    u8 destCol = destX >> 3;
+    u8 row = TILE_ROW(srcY + (TILE_HEIGHT - 1));
+    const u8 *cells = ai.world->cells;
+    u16 i;
+
+    if (row >= VRAM_TILES_V - 1)
+        return -1;
+    i = VRAM_ROW(row) + col;
 
     //try direct on X axis
-    while (srcX > 0 && srcX < VRAM_TILES_H * TILE_WIDTH) {
-        tile = GetTileAtFeet(srcX, srcY);
-        tileUnder = GetTileAtFeet(srcX, srcY + TILE_HEIGHT);
+    while (col > 0 && col < VRAM_TILES_H) {
+        cell = AI_CELL_AT(cells, i);
+        cellUnder = AI_CELL_AT(cells, i + VRAM_TILES_H);
 
-        if ((srcX >> 3) == (destX >> 3))
-            return srcX; //found target
-        if (IsTileBlocking(tile))
+        if (col == destCol)
+            return col << 3; //found target
+        if (AI_CELL_BLOCKING(cell))
             return -1; //dead end, blocked by a wall or cliff
-        if (tileUnder == TILE_BG && tile != TILE_ROPE)
+        if (cellUnder == AI_CELL_BG && cell != AI_CELL_ROPE)
             return -1;
 
-        srcX += (dir * TILE_WIDTH);
+        col += dir;
+        i += dir;
 
     }
 
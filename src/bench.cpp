@@ -0,0 +1,146 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//micro benchmarks, add -DBENCHMARK to the CFLAGS of the project to run them
+//at startup instead of the game, results are in system clock cycles per call.
+//tools/host/bench.cpp runs them on the host with BENCH_HOST defined.
+#ifdef BENCHMARK
+
+#include <propeller.h>
+
+#define BENCH_CALLS         256
+
+#define BENCH(label, expr) \
+    start = CNT; \
+    for (u16 i = 0; i < BENCH_CALLS; i++) { \
+        benchSink += (expr); \
+    } \
+    PrintBenchResult(label, (CNT - start) / BENCH_CALLS);
+
+u32 benchSink;
+u8 benchRow;
+
+void PrintBenchResult(const char *label, unsigned long cycles) {
+#ifdef BENCH_HOST
+    printf("%-16s %12lu\n", label, cycles);
+#else
+    u8 x = 28;
+
+    Print(1, benchRow, label);
+    do {
+        SetTile(x--, benchRow, (cycles % 10) + CHAR_ZERO);
+        cycles /= 10;
+    } while (cycles > 0);
+    benchRow++;
+#endif
+}
+
+//reference implementations, as they were before the lookup tables
+uint8_t BenchTileAtFeetDiv(uint8_t x, uint8_t y) {
+    return vram[((((y + (TILE_HEIGHT - 1)) / TILE_HEIGHT)) * VRAM_TILES_H) + ((x + 4) >> 3)];
+}
+
+uint8_t BenchTileNeighborhoodDiv(uint8_t x, uint8_t y) {
+    u8 col = (x + 4) >> 3;
+    return vram[((((y + (TILE_HEIGHT - 1)) / TILE_HEIGHT)) * VRAM_TILES_H) + col]
+        + vram[((((y + 1) / TILE_HEIGHT)) * VRAM_TILES_H) + col]
+        + vram[((((y + TILE_HEIGHT) / TILE_HEIGHT)) * VRAM_TILES_H) + col];
+}
+
+uint8_t BenchTileNeighborhood(uint8_t x, uint8_t y) {
+    return GetTileAtFeet(x, y) + GetTileAtHead(x, y) + GetTileUnder(x, y);
+}
+
+uint8_t BenchTileSolidChain(uint8_t tileId) {
+    return (tileId == TILE_BREAKABLE || tileId == TILE_UNBREAKABLE || tileId == TILE_LADDER || tileId == TILE_BG_STEP_ON);
+}
+
+//level row through levelTiles a nibble at a time, as the decoders did
+uint8_t BenchDecodeRowNibbles(uint8_t y) {
+    u8 cells[FIELD_WIDTH];
+    u16 pos = y * LEVEL_ROW_BYTES;
+
+    for (u8 x = 0; x < FIELD_WIDTH; x += 2) {
+        cells[x] = levelTiles[game.map[pos] >> 4];
+        cells[x + 1] = levelTiles[game.map[pos++] & 0x0f];
+    }
+    return cells[0] + cells[FIELD_WIDTH - 1];
+}
+
+uint8_t BenchDecodeRow(uint8_t y) {
+    u8 cells[LEVEL_ROW_CELLS];
+    const u8 *row = DecodeMapRow(y, levelTiles, cells);
+
+    return row[0] + row[FIELD_WIDTH - 1];
+}
+
+//row scan of the ai through AiCellAtFeet, as findCliffOnPath did it
+int16_t BenchCliffOnPathCalls(uint8_t x, uint8_t y, int8_t dir) {
+    u8 cell, cellUnder;
+    x &= 0xf8;
+
+    while (x > 0 && x < VRAM_TILES_H * TILE_WIDTH) {
+        cell = AiCellAtFeet(x, y);
+        cellUnder = AiCellAtFeet(x, y + TILE_HEIGHT);
+
+        if (IsAiCellBlocking(cell))
+            return -1;
+        if (cellUnder == AI_CELL_BG || cellUnder == AI_CELL_FAKE)
+            return x;
+        x += (dir * TILE_WIDTH);
+    }
+
+    return -1;
+}
+
+void RunBenchmarks() {
+    u32 start;
+
+    //tile coordinates, y / TILE_HEIGHT against TILE_ROW
+    BENCH("TILE AT FEET DIV", BenchTileAtFeetDiv(i & 0xf8, i & 0xbf));
+    BENCH("TILE AT FEET LUT", GetTileAtFeet(i & 0xf8, i & 0xbf));
+    //the three lookups done by ProcessPlayer for every entity
+    BENCH("NEIGHBORHOOD DIV", BenchTileNeighborhoodDiv(i & 0xf8, i & 0xaf));
+    BENCH("NEIGHBORHOOD LUT", BenchTileNeighborhood(i & 0xf8, i & 0xaf));
+    //tile predicates, comparisons against the tileFlags table
+    BENCH("SOLID CHAIN", BenchTileSolidChain(i & 0x1f));
+    BENCH("SOLID FLAGS", TILE_HAS(i & 0x1f, TILE_FLAG_SOLID));
+    //one row of the level, as read by UnpackGameMap and the other decoders
+    ext_data_read(HIGH_EEPROM_OFFSET(&levels[0]), game.map, LEVEL_SIZE);
+    BENCH("LEVEL ROW NIBBLES", BenchDecodeRowNibbles(i & (FIELD_HEIGHT - 1)));
+    BENCH("LEVEL ROW SWAR", BenchDecodeRow(i & (FIELD_HEIGHT - 1)));
+    //a row scan of findPath, LMM against the FCACHE kernel
+    ai.world = &aiMailbox.world[aiMailbox.published];
+    BENCH("CLIFF SCAN LMM", BenchCliffOnPathCalls(i & 0xf8, (i >> 4) * TILE_HEIGHT, (i & 1) ? DIR_RIGHT : DIR_LEFT));
+    BENCH("CLIFF SCAN FCACHE", findCliffOnPath(i & 0xf8, (i >> 4) * TILE_HEIGHT, (i & 1) ? DIR_RIGHT : DIR_LEFT));
+}
+
+void Benchmark() {
+    ClearVram();
+    benchRow = 0;
+    Print(1, benchRow++, "BENCHMARK        CYCLES/CALL");
+    benchRow++;
+    RunBenchmarks();
+
+    while (1) {
+        WaitVsync(1);
+    }
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//joypad service: a cog samples the joypad at INPUT_SAMPLE_HZ, debounces it and
+//queues press, release and repeat events, so short presses are not missed
+//between frames and menus don't spin on ReadJoypad. Add -DINPUT_SAME_COG to
+//the CFLAGS to sample on the main cog instead, each time input is read.
+#ifndef INPUT_SAME_COG
+
+#include <propeller.h>
+
+u32 inputStack[INPUT_STACK_LONGS];
+
+#endif
+
+void StartInputCog() {
+#ifndef INPUT_SAME_COG
+    PROFILE_FILL_STACK(inputStack);
+    cogstart(InputCog, NULL, inputStack, sizeof(inputStack));
+
+    //the pins are the OR of all cogs, the main cog holding them high would
+    //hide the pulses of the input cog
+    DIRA &= ~JOYPAD_OUTPUTS;
+#endif
+}
+
+//input cog side
+
+#ifndef INPUT_SAME_COG
+
+void InputCog(void *par) {
+    u32 next = CNT;
+
+    //take over the joypad outputs, idle high as Initialize leaves them
+    OUTA |= JOYPAD_OUTPUTS;
+    DIRA |= JOYPAD_OUTPUTS;
+
+    while (1) {
+        SampleInput();
+        next += CLKFREQ / INPUT_SAMPLE_HZ;
+        waitcnt(next);
+    }
+}
+
+#endif
+
+void PostInputEvent(uint16_t event) {
+    u8 head = input.head;
+    u8 next = (head + 1) & (INPUT_QUEUE_SIZE - 1);
+
+    //drop the event if nobody is reading
+    if (next == input.tail)
+        return;
+
+    input.queue[head] = event;
+    input.head = next;
+}
+
+void PostInputEvents(uint16_t kind, uint16_t buttons) {
+    for (u16 btn = 1; btn & INPUT_BUTTONS; btn <<= 1) {
+        if (buttons & btn) {
+            PostInputEvent(kind | btn);
+        }
+    }
+}
+
+void SampleInput() {
+    u16 raw = ReadJoypad(0);
+    u16 state = input.state;
+
+    if (raw != input.raw) {
+        input.raw = raw;
+        input.stable = 0;
+    }
+
+    if (input.stable < INPUT_DEBOUNCE) {
+        input.stable++;
+        if (input.stable == INPUT_DEBOUNCE && raw != state) {
+            PostInputEvents(INPUT_RELEASE, state & ~raw);
+            PostInputEvents(INPUT_PRESS, raw & ~state);
+            input.state = raw;
+            input.repeatDelay = INPUT_REPEAT_DELAY;
+            input.repeats = 0;
+        }
+        return;
+    }
+
+    //held directions repeat, faster after a few repeats
+    if ((state & INPUT_REPEAT_BUTTONS) != 0 && --input.repeatDelay == 0) {
+        PostInputEvents(INPUT_REPEAT, state & INPUT_REPEAT_BUTTONS);
+        if (input.repeats < INPUT_REPEAT_STEPS) {
+            input.repeats++;
+            input.repeatDelay = INPUT_REPEAT_RATE;
+        } else {
+            input.repeatDelay = INPUT_REPEAT_FAST;
+        }
+    }
+}
+
+//main cog side
+
+//next queued event, 0 if none
+uint16_t GetInputEvent() {
+    u8 tail = input.tail;
+    u16 event;
+
+#ifdef INPUT_SAME_COG
+    SampleInput();
+#endif
+    if (tail == input.head)
+        return 0;
+
+    event = input.queue[tail];
+    input.tail = (tail + 1) & (INPUT_QUEUE_SIZE - 1);
+    return event;
+}
+
+void FlushInput() {
+    input.tail = input.head;
+}
+
+uint16_t InputState() {
+#ifdef INPUT_SAME_COG
+    SampleInput();
+#endif
+    return input.state;
+}
+
+//drains the queue, returns the buttons pressed since the last call
+uint16_t ReadInputPresses() {
+    u16 event, buttons = 0;
+
+    while ((event = GetInputEvent()) != 0) {
+        if ((event & INPUT_KIND) == INPUT_PRESS) {
+            buttons |= (event & INPUT_BUTTONS);
+        }
+    }
+    return buttons;
+}
+
+//buttons held, plus those pressed and already released since the last frame
+uint16_t ReadGameInput() {
+    u16 buttons = ReadInputPresses();
+
+    return buttons | input.state;
+}
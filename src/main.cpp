@@ -28,8 +28,30 @@
 
 #define HEIGHT_12           8
 
+//storage of the game state, the host tools run several games at once and
+//define it as thread_local
+#ifndef GAME_STATE
+#define GAME_STATE
+#endif
+
+//invariants of the game state, checked by the host tools only
+#ifndef GAME_CHECK
+#define GAME_CHECK(cond)
+#endif
+
+//functions loaded whole into the fcache of the LMM kernel and run natively
+//by the cog, for hot loops. Put it on its own line before the definition, the
+//function must not call other functions and tools/elfbudget.cpp --fcache
+//checks that it fits. The host tools define it empty
+#ifndef FCACHE
+#define FCACHE              __attribute__((fcache))
+#endif
+
 #define MAX_PLAYERS         6
 #define LEVEL_SIZE          224
+#define LEVEL_ROW_BYTES     14  //two cells per byte, the high nibble first
+#define LEVEL_CODES         16  //entries of the tables DecodeMapRow maps the cells through
+#define LEVEL_ROW_CELLS     32  //cells decoded by DecodeMapRow, whole words around the row
 #define LEVELS_COUNT        50
 
 #define EEPROM_ID           8
@@ -37,6 +59,28 @@
 
 #define FIELD_WIDTH         28
 #define FIELD_HEIGHT        16
+#define TILE_CELL_NONE      0xff    //cellX of a player without a valid tile cache
+
+//tileFlags bits, the table is generated from the tileset by tools/p8xgen.cpp
+#define TILE_FLAG_SOLID         0x01    //can be stood on
+#define TILE_FLAG_BLOCKING      0x02    //cannot be walked or climbed into
+#define TILE_FLAG_LADDER        0x04
+#define TILE_FLAG_ROPE          0x08
+#define TILE_FLAG_GOLD          0x10
+#define TILE_FLAG_HOLE          0x20    //dug brick, crumbling or open
+#define TILE_FLAG_BACKGROUND    0x40
+#define TILE_FLAG_DEADLY        0x80    //crushes whoever has the feet in it
+#define TILE_HAS(tileId, flag)  ((tileId) < TILE_FLAGS_COUNT && (tileFlags[tileId] & (flag)))
+
+//tile coordinates without divisions, TILE_HEIGHT is not a power of 2
+//and the Propeller has no hardware divider
+#if (TILE_HEIGHT % 4) != 0
+#error "TILE_HEIGHT must be a multiple of 4"
+#endif
+#define TILE_ROW_TABLE_SIZE (((255 + TILE_HEIGHT) >> 2) + 1)
+#define VRAM_ROW_TABLE_SIZE (((255 + TILE_HEIGHT) / TILE_HEIGHT) + 1)
+#define TILE_ROW(y)         (tileRowTable[(y) >> 2])    //y / TILE_HEIGHT for 0 <= y < 256 + TILE_HEIGHT
+#define VRAM_ROW(row)       (vramRowOffset[row])        //row * VRAM_TILES_H
 
 #define ACTION_NONE         0
 #define ACTION_WALK         1
@@ -48,6 +92,10 @@
 #define ACTION_INHOLE       7
 #define ACTION_RESPAWN      8
 
+//actions steered by the joypad or the ai commands, the others play out alone
+#define ACTIONS_COMMANDED   ((1 << ACTION_WALK) | (1 << ACTION_CLIMB) | (1 << ACTION_CLING))
+#define IS_ACTION_COMMANDED(action) ((ACTIONS_COMMANDED >> (action)) & 1)
+
 #define TILE_OFFSET_X       0
 #define TILE_OFFSET_Y       0
 
@@ -87,44 +135,312 @@
 #define SFX_VOLUME          128
 #define FX_PAUSE            12
 
-#define ANIMATION_SLOTS_COUNT       32
+#define ANIMATION_SLOTS_COUNT       8   //fire beam and trapped enemies, one per player at most
+#define ANIMATION_WHEEL_SIZE        32  //must be a power of 2
+#define ANIMATION_NONE              -1
 #define ANIM_CMD_END                0
 #define ANIM_CMD_SETTILE            1
 #define ANIM_CMD_SETSPRITE          2
 #define ANIM_CMD_TURNOFFSPRITE      3
 #define ANIM_CMD_SETSPRITEATTR      4
 #define ANIM_CMD_FLIP_SPRITE_ATTR   5
+#define ANIM_CMD_DELAY16            6   //16 bit delay, low byte first
+#define ANIM_CMD_LOOP               7   //count, bytes to jump back
+#define ANIM_CMD_MOVE               8   //move the owner by dx (facing direction), dy
+#define ANIM_CMD_EVENT              9   //invoke AnimationEvent on the owner
 #define ANIM_CMD_DELAY              0x80
 
+#define MAX_HOLES           16
+#define HOLE_STEPS          12
+#define HOLE_DIG_DELAY      16  //frames from the shot to the first crumbling tile
+#define HOLE_NONE           -1
+
+#define ANIM_EVENT_FIRE_DONE        0
+#define ANIM_EVENT_LEAVE_HOLE       1
+
 #define MAX_GOLD 32
 
+//cells of the level snapshot kept in game.map once a level is unpacked, 2 per
+//byte (high nibble first) as the levels in EEPROM, see TakeLevelSnapshot
+#define SNAPSHOT_BG             0
+#define SNAPSHOT_BREAKABLE      1
+#define SNAPSHOT_UNBREAKABLE    2
+#define SNAPSHOT_LADDER         3
+#define SNAPSHOT_ROPE           4
+#define SNAPSHOT_FAKE           5
+#define SNAPSHOT_SHADOW         6
+#define SNAPSHOT_GOLD           7
+#define SNAPSHOT_EXIT_LADDER    8   //background until all gold is collected
+#define SNAPSHOT_CELLS          9
+
+#define LEVEL_EXIT_LADDER       0xfd    //levelTiles entries that are not tiles
+#define LEVEL_SPAWN_ENEMY       0xfe
+#define LEVEL_SPAWN_PLAYER      0xff
+#define LEVEL_NONE              0xff
+
+//tile classes in the ai world snapshot
+#define AI_CELL_OTHER           0
+#define AI_CELL_BG              1
+#define AI_CELL_LADDER          2
+#define AI_CELL_ROPE            3
+#define AI_CELL_BREAKABLE       4
+#define AI_CELL_UNBREAKABLE     5
+#define AI_CELL_FAKE            6
+#define AI_CELL_STEP_ON         7
+#define AI_CELL_DESTROY         8
+#define AI_CELLS_SIZE           ((VRAM_TILES_H * VRAM_TILES_V + 1) / 2)
+#define AI_CELL_AT(cells, i)    (((cells)[(i) >> 1] >> (((i) & 1) << 2)) & 0x0f)
+#define AI_CELL_BLOCKING(cell)  ((cell) == AI_CELL_BREAKABLE || (cell) == AI_CELL_UNBREAKABLE || (cell) == AI_CELL_STEP_ON)
+//the thread state of the cog (EXTRA_STACK_BYTES, see cogstart) and the frames
+//of AiCog > AiStep > Ai > CachedPath > findPath, the scans are leaves
+#define AI_STACK_LONGS          ((EXTRA_STACK_BYTES / 4) + 64)
+#define AI_PATH_CACHE_SIZE      8       //findPath results kept by the ai cog, must be a power of 2
+
+//keeps the compiler from moving plain stores to hub past the volatile store
+//that hands them over to another cog
+#define COMPILER_BARRIER()      __asm__ volatile("" ::: "memory")
+
+//random streams, the seed of each one is derived from the level seed and its id
+#define RANDOM_RESPAWN          0
+#define RANDOM_GOLD             1       //+ enemy id
+#define RANDOM_AI               (RANDOM_GOLD + MAX_PLAYERS)    //+ enemy id
+
+//input events, a single BTN_* bit with the kind of edge in the top bits
+#define INPUT_PRESS             0x4000
+#define INPUT_RELEASE           0x8000
+#define INPUT_REPEAT            0xc000
+#define INPUT_KIND              0xc000
+#define INPUT_BUTTONS           0x3fff
+#define INPUT_QUEUE_SIZE        16      //must be a power of 2
+#define INPUT_SAMPLE_HZ         240
+#define INPUT_DEBOUNCE          3       //samples a change must last to be accepted
+#define INPUT_REPEAT_BUTTONS    (BTN_UP | BTN_DOWN | BTN_LEFT | BTN_RIGHT)
+#define INPUT_REPEAT_DELAY      40      //samples before a held direction repeats
+#define INPUT_REPEAT_RATE       40
+#define INPUT_REPEAT_FAST       16      //rate after INPUT_REPEAT_STEPS repeats
+#define INPUT_REPEAT_STEPS      4
+//the thread state of the cog (EXTRA_STACK_BYTES, see cogstart) and the frames
+//of InputCog > SampleInput > PostInputEvents, ReadJoypad is a leaf
+#define INPUT_STACK_LONGS       ((EXTRA_STACK_BYTES / 4) + 40)
+//latch and clock of the joypads, driven by ReadJoypad from the cog that calls
+//it. Initialize sets them as outputs of the main cog only
+#define JOYPAD_OUTPUTS          ((1 << 8) | (1 << 9))
+
+//profiler records, see profile.cpp: CNT in the top 24 bits and an event in the
+//low byte, the zone (bit 4 set for zones run by the ai cog) and PROFILE_EXIT
+#define PROFILE_GAME_FRAME          0
+#define PROFILE_PROCESS_PLAYER      1
+#define PROFILE_PROCESS_ENEMY       2
+#define PROFILE_PROCESS_GOLD        3
+#define PROFILE_PROCESS_ANIMATIONS  4
+#define PROFILE_UNPACK_GAME_MAP     5
+#define PROFILE_BLIT_LEVEL_PREVIEW  6
+#define PROFILE_RESTART_LEVEL       7
+#define PROFILE_AI                  0x10
+#define PROFILE_FIND_PATH           0x11
+#define PROFILE_EXIT                0x80
+#define PROFILE_DROPPED             0x60    //| ring, records lost in the top 24 bits
+#define PROFILE_STACK               0x70    //| PROFILE_STACK_*, longs never touched in the top 24 bits
+#define PROFILE_SYNC                0xff    //whole record, every PROFILE_SYNC_RECORDS
+#define PROFILE_SYNC_RECORDS        64
+#define PROFILE_RING_SIZE           64      //records, must be a power of 2
+#define PROFILE_TX_PIN              30
+#define PROFILE_BAUD                115200
+//cogstart keeps the thread state of the cog in the stack, EXTRA_STACK_BYTES,
+//the rest holds ProfileCog > ProfileSend > ProfileTx
+#define PROFILE_STACK_LONGS         ((EXTRA_STACK_BYTES / 4) + 32)
+#define PROFILE_STACK_AI            0
+#define PROFILE_STACK_INPUT         1
+#define PROFILE_STACK_PROFILER      2
+#define PROFILE_STACKS              3
+#define PROFILE_STACK_FILL          0x5ca1ab1e  //cog stacks are filled with it before starting
+
+#ifdef PROFILE
+#define PROFILE_BEGIN(zone)         ProfileRecord(zone)
+#define PROFILE_END(zone)           ProfileRecord((zone) | PROFILE_EXIT)
+#define PROFILE_FILL_STACK(stack)   ProfileFillStack(stack, sizeof(stack) / sizeof(u32))
+#else
+#define PROFILE_BEGIN(zone)
+#define PROFILE_END(zone)
+#define PROFILE_FILL_STACK(stack)
+#endif
+
+//tasks, see task.cpp: the screens run one at a time in front, the background
+//tasks in the frames the screen in front spends waiting
+#define TASK_TITLE              0
+#define TASK_LEVEL              1
+#define TASK_PAUSE              2
+#define TASK_GAME_OVER          3
+#define TASK_SAVE               4
+#define TASK_BACKGROUND         TASK_SAVE   //first background task
+#define TASK_COUNT              5
+#define TASK_NONE               0xff
+
+#define FRAME_HZ                60
+#define FRAME_CATCH_UP          3   //ticks added to a frame after an overrun, gameplay slows down beyond
+
+#define TASK_WAITING            0   //nothing done this frame but waiting
+#define TASK_BUSY               1
+#define TASK_DONE               2
+
+//a task function resumes at the line it returned from, its locals are lost on
+//every wait so what it keeps goes in screenState. No switch across a wait.
+#define TASK_BEGIN(id)          Task *task = &scheduler.tasks[id]; switch (task->line) { case 0:
+#define TASK_END()              } task->line = 0; return TASK_DONE
+#define TASK_YIELD()            do { task->line = __LINE__; return TASK_BUSY; case __LINE__:; } while (0)
+#define TASK_SLEEP(frames)      do { task->wake = scheduler.frame + (frames); task->line = __LINE__; return TASK_WAITING; case __LINE__:; } while (0)
+#define TASK_WAIT_UNTIL(cond)   do { task->line = __LINE__; case __LINE__: if (!(cond)) return TASK_WAITING; } while (0)
+
 //static vars
-typedef struct Player {
-    s32 x;              //24:8 fixed point
-    s32 y;              //24:8 fixed point
-    s32 playerSpeed;    //24:8 fixed point
-    u8 frame;           //4:4 fixed point
-    u8 frameSpeed;      //4:4 fixed point
-    s8 dir;             //facing direction (-1=left, 1=right)
-    u8 action;          //current action (i.e: walk, fall,etc)
-    u8 lastAction;
-    u8 lives;           //remaining lives
-    u8 spriteIndex;     //sprite slot used
-    bool active;        //visible\active
-    bool died;
-
-    u8 tileAtFeet;
-    u8 tileAtHead;
-    u8 tileUnder;
-
-    s8 capturedGoldId;
-    s8 lastCapturedGoldId;
-    u16 capturedGoldDelay;
-    u8 lastAiAction;
-    s16 aiTarget;
-    u8 respawnX;
-    u8 stuckDelay;      //when enemy is stuck, wait some random # of frames
-} Player;
+
+//players and enemies, one array per field so the passes over all of them
+//(collisions, hole occupancy, ai) only read the fields they need
+typedef struct Players {
+    //position and motion
+    u16 x[MAX_PLAYERS];             //8:8 fixed point
+    u16 y[MAX_PLAYERS];             //8:8 fixed point
+    u16 playerSpeed[MAX_PLAYERS];   //8:8 fixed point
+    u8 frame[MAX_PLAYERS];          //4:4 fixed point
+    u8 frameSpeed[MAX_PLAYERS];     //4:4 fixed point
+    s8 dir[MAX_PLAYERS];            //facing direction (-1=left, 1=right)
+
+    //state
+    u8 action[MAX_PLAYERS];         //current action (i.e: walk, fall,etc)
+    u8 lastAction[MAX_PLAYERS];
+    u8 lives[MAX_PLAYERS];          //remaining lives
+    u8 spriteIndex[MAX_PLAYERS];    //sprite slot used
+    u8 spriteBase[MAX_PLAYERS];     //first frame in the sprite tiles, enemies have their own frames
+    bool active[MAX_PLAYERS];       //visible\active
+    bool died[MAX_PLAYERS];
+    s8 animSlot[MAX_PLAYERS];       //animation driving the player, if any
+
+    //tile cache
+    u8 tileAtFeet[MAX_PLAYERS];
+    u8 tileAtHead[MAX_PLAYERS];
+    u8 tileUnder[MAX_PLAYERS];
+    u8 cellX[MAX_PLAYERS];          //tile column of the cached tiles above
+    u8 cellY[MAX_PLAYERS];          //tile row of the cached tiles above
+    u8 cellTop[MAX_PLAYERS];        //y range where the cached tiles stay the same
+    u8 cellBottom[MAX_PLAYERS];
+
+    //gold and ai
+    s8 capturedGoldId[MAX_PLAYERS];
+    s8 lastCapturedGoldId[MAX_PLAYERS];
+    u16 capturedGoldDelay[MAX_PLAYERS];
+    u8 respawnX[MAX_PLAYERS];
+    u16 aiButtons[MAX_PLAYERS];     //last command received from the ai cog
+} Players;
+
+//what the ai cog plans on, the main cog fills one while the ai cog reads the other
+typedef struct AiWorld {
+    u8 cells[AI_CELLS_SIZE];        //AI_CELL_* of each vram tile, 2 per byte, low nibble first
+    u8 x[MAX_PLAYERS];
+    u8 y[MAX_PLAYERS];
+    u8 action[MAX_PLAYERS];
+    s8 dir[MAX_PLAYERS];
+    bool active[MAX_PLAYERS];
+    u8 level;                       //changes when a level is unpacked, resets the ai state
+    u16 epoch;                      //bumped when the class of a cell changes
+    u32 seed;                       //seed of the random streams of the ai cog
+} AiWorld;
+
+//a findPath result and what it was computed from, the world is the same as
+//long as the epoch is. The player column is enough as findPath only looks at
+//the tile of destX, the other coordinates are compared to the pixel
+typedef struct AiPath {
+    u16 epoch;
+    u8 srcX;
+    u8 srcY;
+    u8 destX;                       //& 0xf8
+    u8 destY;
+    s8 dir;
+    bool climbingUp;                //lastAction was AI_ACTION_CLIMB_UP
+    u8 action;
+    s16 target;
+} AiPath;
+
+//shared by the main cog and the ai cog
+typedef struct AiMailbox {
+    AiWorld world[2];
+    volatile u8 published;          //world the ai cog plans on, the other one is being filled
+    volatile u16 sequence;          //bumped by the main cog for each published world
+    volatile u16 done;              //sequence of the last world planned by the ai cog
+    volatile u16 buttons[MAX_PLAYERS];  //joypad-style command for each enemy
+    volatile s8 dir[MAX_PLAYERS];   //new facing direction, 0 if unchanged
+} AiMailbox;
+
+//joypad service, the queue is written by the input cog and read by the main cog
+typedef struct Input {
+    volatile u16 queue[INPUT_QUEUE_SIZE];
+    volatile u8 head;               //next event written, owned by the input cog
+    volatile u8 tail;               //next event read, owned by the main cog
+    volatile u16 state;             //debounced buttons held
+
+    //input cog only
+    u16 raw;                        //last sample
+    u8 stable;                      //samples raw has stayed the same
+    u8 repeatDelay;                 //samples before the next repeat
+    u8 repeats;
+} Input;
+
+//private to the ai cog
+typedef struct AiState {
+    const AiWorld *world;           //world being planned on
+    s16 target[MAX_PLAYERS];
+    u8 lastAction[MAX_PLAYERS];
+    u8 stuckDelay[MAX_PLAYERS];     //when enemy is stuck, wait some random # of frames
+    s8 dir[MAX_PLAYERS];
+    u8 level;
+    u32 seed;                       //world seed the streams below come from
+    u32 random[MAX_PLAYERS];        //xorshift32 stream of each enemy
+    AiPath paths[AI_PATH_CACHE_SIZE];
+    u8 pathCount;                   //paths in use, emptied on a new level
+    u8 pathNext;                    //replaced by the next path found, round robin
+    u16 searches;                   //findPath calls that scanned the world, free running
+    u16 pathHits;                   //findPath calls answered by the cache, free running
+    u16 skipped;                    //plans skipped for enemies that could not act on them, free running
+} AiState;
+
+//xorshift32 streams of the main cog, one per use and per enemy so a draw in
+//one never shifts the sequence of another. Plain state, snapshots and
+//replays save and restore it as is
+typedef struct Random {
+    u32 seed;                       //level seed the streams come from
+    u32 respawn;                    //respawn column of enemies
+    u32 gold[MAX_PLAYERS];          //how long each enemy carries gold
+} Random;
+
+//records of the zones run by one cog, sent by the profiler cog
+typedef struct ProfileRing {
+    volatile u32 records[PROFILE_RING_SIZE];
+    volatile u8 head;               //next record written, owned by the cog profiled
+    volatile u8 tail;               //next record sent, owned by the profiler cog
+    volatile u16 dropped;           //records lost on a full ring, free running
+} ProfileRing;
+
+typedef struct Task {
+    u16 line;                       //where the task resumes, 0 from the top
+    u16 wake;                       //frame the task sleeps until
+} Task;
+
+typedef struct Scheduler {
+    Task tasks[TASK_COUNT];
+    u32 vsyncCnt;                   //CNT when the last vsync was counted
+    u16 frame;                      //vsyncs counted, sleeps are in real time
+    u8 ticks;                       //gameplay ticks due in this frame
+    u8 screen;                      //task in front
+    u8 caller;                      //screen resumed when the one in front is done, or TASK_NONE
+} Scheduler;
+
+//what the screen tasks keep across frames
+typedef struct ScreenState {
+    u16 frame;                      //level intro, blinks the player
+    u8 step;                        //loop counter of an animation
+    u8 anim;                        //title bars
+    u8 tx, ty;                      //title layout
+    u8 option;                      //pause menu entry and its cursor column
+    u8 cursor;
+} ScreenState;
 
 typedef struct Gold {
     u8 x;
@@ -137,10 +453,21 @@ typedef struct Animation {
     u8 commandCount;
     u8 x;
     u8 y;
-    u8 delay;
     u8 param1;
+    u8 loopCount;
+    s8 owner;           //player id the animation acts on
+    u16 wakeFrame;      //frame at which the command stream resumes
+    s8 next;            //next slot in the same wheel bucket or in the free list
 } Animation;
 
+typedef struct Hole {
+    u8 x;
+    u8 y;
+    u8 step;            //next entry of holeTiles to draw
+    s8 occupant;        //enemy trapped in the hole, -1 if empty
+    u16 wakeFrame;      //animation frame of the next step
+} Hole;
+
 typedef struct Game {
     u8 goldCount;       //the number of gold to collect
     u8 goldCollected;   //remaining to collect
@@ -148,15 +475,29 @@ typedef struct Game {
     u8 goldAnimSpeed;
     Gold gold[MAX_GOLD];
     Animation animations[ANIMATION_SLOTS_COUNT]; //data for animations
+    s8 animWheel[ANIMATION_WHEEL_SIZE]; //sleeping animations, bucketed by wake up frame
+    s8 animFree;        //first unused animation slot
+    u16 animFrame;      //animation clock, advanced once per frame
+    Hole holes[MAX_HOLES]; //dug bricks, the first holeCount are in use
+    u8 holeCount;
+    u16 holeWake;       //animation frame of the earliest hole step
     u8 level;
     u8 totalLevels;
     bool exitLadders;
     bool levelComplete;
     bool levelRestart;
     bool levelQuit;
+    bool pauseRequested; //START pressed, the level task opens the pause menu
+    bool saveDirty;     //saveGame changed, written back by the save task
     u8 demoSaveLevel;
     bool displayCredits;
-    u8 map[LEVEL_SIZE];
+    u8 snapshotLevel;   //level whose snapshot is in map, LEVEL_NONE if map holds a level read from EEPROM
+    u8 spawnX[MAX_PLAYERS]; //start tile of each player, 0 if not in the level
+    u8 spawnY[MAX_PLAYERS];
+    union {
+        u8 map[LEVEL_SIZE];
+        u32 mapWords[LEVEL_SIZE / 4]; //map read 32 bits at a time by DecodeMapRow
+    };
 } Game;
 
 #define TITLE1_WIDTH 8
@@ -194,47 +535,80 @@ const u8 playerWalkFrames[] = { SPR_WALK1, SPR_WALK3, SPR_WALK2, SPR_WALK4, SPR_
 const u8 playerClimbFrames[] = { SPR_CLIMB1, SPR_CLIMB2, SPR_CLIMB2, SPR_CLIMB1 };
 const u8 playerClingFrames[] = { SPR_CLING1, SPR_CLING2, SPR_CLING3 };
 
-//animations
-const u8 anim_destroyBrick[] PROGMEM = {
-    ANIM_CMD_DELAY|15,
-    ANIM_CMD_SETTILE, TILE_DESTROY1, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY2, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY3, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY4, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY5, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_BG_HOLE, ANIM_CMD_DELAY|127, ANIM_CMD_DELAY|110,
-    ANIM_CMD_SETTILE, TILE_DESTROY5, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY4, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY3, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY2, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_DESTROY1, ANIM_CMD_DELAY|5,
-    ANIM_CMD_SETTILE, TILE_BREAKABLE,
-    ANIM_CMD_END
+//tile flags, generated from Princesse.p8x by tools/p8xgen.cpp
+#define TILE_FLAGS_COUNT    21
+const u8 tileFlags[TILE_FLAGS_COUNT] = {
+    0,                                                   //TILE_BLACK
+    TILE_FLAG_BACKGROUND,                                //TILE_BG
+    TILE_FLAG_SOLID|TILE_FLAG_BLOCKING|TILE_FLAG_DEADLY, //TILE_BREAKABLE
+    TILE_FLAG_SOLID|TILE_FLAG_BLOCKING,                  //TILE_UNBREAKABLE
+    TILE_FLAG_SOLID|TILE_FLAG_LADDER,                    //TILE_LADDER
+    TILE_FLAG_ROPE,                                      //TILE_ROPE
+    0,                                                   //TILE_BREAKABLE_FAKE
+    TILE_FLAG_GOLD,                                      //TILE_GOLD1
+    TILE_FLAG_GOLD,                                      //TILE_GOLD2
+    TILE_FLAG_GOLD,                                      //TILE_GOLD3
+    TILE_FLAG_GOLD,                                      //TILE_GOLD4
+    TILE_FLAG_BACKGROUND,                                //TILE_SHADOW
+    0,                                                   //TILE_SHADOW2
+    0,                                                   //TILE_SHADOW3
+    TILE_FLAG_HOLE,                                      //TILE_DESTROY1
+    TILE_FLAG_HOLE,                                      //TILE_DESTROY2
+    TILE_FLAG_HOLE,                                      //TILE_DESTROY3
+    TILE_FLAG_HOLE,                                      //TILE_DESTROY4
+    TILE_FLAG_HOLE,                                      //TILE_DESTROY5
+    TILE_FLAG_HOLE,                                      //TILE_BG_HOLE
+    TILE_FLAG_SOLID|TILE_FLAG_BLOCKING,                  //TILE_BG_STEP_ON
 };
-const u8 anim_fire[] PROGMEM = {
-    ANIM_CMD_SETSPRITE,SPR_BEAM1,ANIM_CMD_DELAY|2,
-    ANIM_CMD_SETSPRITE,SPR_BEAM2,ANIM_CMD_DELAY|2,
-    ANIM_CMD_SETSPRITE,SPR_BEAM3,ANIM_CMD_DELAY|2,
-    ANIM_CMD_SETSPRITE,SPR_BEAM4,ANIM_CMD_DELAY|2,
-    ANIM_CMD_SETSPRITE,SPR_BEAM5,ANIM_CMD_DELAY|2,
-    ANIM_CMD_SETSPRITE,SPR_BEAM6,ANIM_CMD_DELAY|2,
-    ANIM_CMD_TURNOFFSPRITE,
-    ANIM_CMD_END
+//end of tile flags
+
+//tile drawn for each code of a level read from EEPROM, empty cells are 0
+const u8 levelTiles[LEVEL_CODES] = {
+    0, TILE_BREAKABLE, TILE_UNBREAKABLE, TILE_LADDER, TILE_ROPE, TILE_BREAKABLE_FAKE,
+    LEVEL_EXIT_LADDER, TILE_GOLD1, LEVEL_SPAWN_ENEMY, LEVEL_SPAWN_PLAYER
 };
 
-const u8 anim_getout_of_hole[] PROGMEM= {
-    ANIM_CMD_SETSPRITE,SPR_FALL+SPR_ENEMY_OFFSET,ANIM_CMD_DELAY|0,
-    ANIM_CMD_FLIP_SPRITE_ATTR,1,ANIM_CMD_DELAY|3,
-    ANIM_CMD_FLIP_SPRITE_ATTR,1,ANIM_CMD_DELAY|3,
-    ANIM_CMD_FLIP_SPRITE_ATTR,1,ANIM_CMD_DELAY|3,
-    ANIM_CMD_FLIP_SPRITE_ATTR,1,ANIM_CMD_DELAY|3,
-    ANIM_CMD_FLIP_SPRITE_ATTR,1,ANIM_CMD_DELAY|3,
-    ANIM_CMD_FLIP_SPRITE_ATTR,1,ANIM_CMD_DELAY|3,
-    ANIM_CMD_SETSPRITE,SPR_WALK4+SPR_ENEMY_OFFSET,ANIM_CMD_DELAY|10,
-    ANIM_CMD_SETSPRITE,SPR_EXIT1+SPR_ENEMY_OFFSET,ANIM_CMD_DELAY|20,
-
-    ANIM_CMD_END
+//tile drawn for each SNAPSHOT_* cell
+const u8 snapshotTiles[LEVEL_CODES] = {
+    TILE_BG, TILE_BREAKABLE, TILE_UNBREAKABLE, TILE_LADDER, TILE_ROPE, TILE_BREAKABLE_FAKE, TILE_SHADOW, TILE_GOLD1, TILE_BG
+};
+
+//ladders shown in a snapshot once all gold is collected
+const u8 exitLadderTiles[LEVEL_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, TILE_LADDER
+};
+
+//tile drawn by each step of a hole and the frames until the next step: the
+//brick crumbles, stays open for a while then fills back
+const u8 holeTiles[HOLE_STEPS] = {
+    TILE_DESTROY1, TILE_DESTROY2, TILE_DESTROY3, TILE_DESTROY4, TILE_DESTROY5, TILE_BG_HOLE,
+    TILE_DESTROY5, TILE_DESTROY4, TILE_DESTROY3, TILE_DESTROY2, TILE_DESTROY1, TILE_BREAKABLE
+};
+const u8 holeDelays[HOLE_STEPS] = { 6, 6, 6, 6, 6, 239, 6, 6, 6, 6, 6, 0 };
+
+//animations, generated from animations.anim by tools/animasm.cpp
+const u8 anim_fire[] PROGMEM = {
+    ANIM_CMD_SETSPRITE, SPR_BEAM1, ANIM_CMD_DELAY|2,
+    ANIM_CMD_SETSPRITE, SPR_BEAM2, ANIM_CMD_DELAY|2,
+    ANIM_CMD_SETSPRITE, SPR_BEAM3, ANIM_CMD_DELAY|2,
+    ANIM_CMD_SETSPRITE, SPR_BEAM4, ANIM_CMD_DELAY|2,
+    ANIM_CMD_SETSPRITE, SPR_BEAM5, ANIM_CMD_DELAY|2,
+    ANIM_CMD_SETSPRITE, SPR_BEAM6, ANIM_CMD_DELAY|2,
+    ANIM_CMD_TURNOFFSPRITE, ANIM_CMD_DELAY|5,
+    ANIM_CMD_EVENT, ANIM_EVENT_FIRE_DONE, ANIM_CMD_END
 };
+const u8 anim_inhole[] PROGMEM = {
+    ANIM_CMD_DELAY16, 0x95, 0x00,
+    ANIM_CMD_SETSPRITE, SPR_FALL+SPR_ENEMY_OFFSET, ANIM_CMD_DELAY|0,
+    ANIM_CMD_FLIP_SPRITE_ATTR, 1, ANIM_CMD_DELAY|3,
+    ANIM_CMD_LOOP, 4, 6, ANIM_CMD_FLIP_SPRITE_ATTR, 1, ANIM_CMD_DELAY|2,
+    ANIM_CMD_MOVE, 0x00, 0xfe, ANIM_CMD_DELAY|0,
+    ANIM_CMD_FLIP_SPRITE_ATTR, 1, ANIM_CMD_DELAY|3,
+    ANIM_CMD_SETSPRITE, SPR_WALK4+SPR_ENEMY_OFFSET, ANIM_CMD_MOVE, 0x01, 0xfd, ANIM_CMD_DELAY|4,
+    ANIM_CMD_MOVE, 0x02, 0xfd, ANIM_CMD_DELAY|4,
+    ANIM_CMD_MOVE, 0x03, 0xfc, ANIM_CMD_EVENT, ANIM_EVENT_LEAVE_HOLE, ANIM_CMD_END
+};
+//end of animations
 
 #define SCORE_LEVEL_COMPLETE 1500
 #define SCORE_GOLD_COLLECTED 250
@@ -253,7 +627,7 @@ typedef struct {
     u8 reservedData[6];
 } EepromBlock;
 
-EepromBlock saveGame;
+GAME_STATE EepromBlock saveGame;
 
 //tileset defines
 
@@ -263,8 +637,20 @@ EepromBlock saveGame;
 
 //variable defines
 
-Game game;
-Player player[MAX_PLAYERS];
+GAME_STATE Game game;
+GAME_STATE Players player;
+GAME_STATE AiMailbox aiMailbox;
+GAME_STATE AiState ai;
+GAME_STATE Random rng;
+GAME_STATE Input input;
+GAME_STATE u16 aiReceived;  //mailbox sequence of the commands in player.aiButtons
+GAME_STATE u8 tileRowTable[TILE_ROW_TABLE_SIZE];
+GAME_STATE u16 vramRowOffset[VRAM_ROW_TABLE_SIZE];
+GAME_STATE Scheduler scheduler;
+GAME_STATE ScreenState screenState;
+#ifdef PROFILE
+ProfileRing profile[2];     //main cog, ai cog
+#endif
 
 int main()
 {
@@ -278,110 +664,175 @@ int main()
     //FadeOut(0, true);
 
     loadEeprom();
+    InitTileTables();
+    StartAiCog();
+    StartInputCog();
+#ifdef PROFILE
+    StartProfileCog();
+#endif
+
+#ifdef BENCHMARK
+    Benchmark();
+#endif
 
     //Logo();
 
     game.level = 0;
+    game.snapshotLevel = LEVEL_NONE;
+    StartTasks();
     while (1) {
-        game.displayCredits = false;
+        WaitVsync(1);
+        RunTasks();
+    }
+}
 
-        player[SPR_INDEX_PLAYER].lives = 6;
+//the levels played from the title screen, until the last life or a quit
+uint8_t LevelTask() {
+    TASK_BEGIN(TASK_LEVEL);
 
-        hideAllSprites();
-        ClearVram();
-        GameTitle();
-        hideAllSprites();
+    SetSpritesTileTable(lode_sprites);
 
-        SetSpritesTileTable(lode_sprites);
+    //SetSpriteVisibility(true);
+    //SetUserRamTilesCount(1);
+    do {
 
-        //SetSpriteVisibility(true);
-        //SetUserRamTilesCount(1);
-        do {
+        InitAnimations();
+
+        if (game.snapshotLevel == game.level) {
+            //died or restarted, start again from the snapshot
+            PROFILE_BEGIN(PROFILE_RESTART_LEVEL);
+            RestartLevel();
+            PROFILE_END(PROFILE_RESTART_LEVEL);
+        } else {
+            PROFILE_BEGIN(PROFILE_UNPACK_GAME_MAP);
+            UnpackGameMap(game.level);
+            PROFILE_END(PROFILE_UNPACK_GAME_MAP);
+        }
+        FadeIn(3, false);
 
-            for (u8 i = 0; i < ANIMATION_SLOTS_COUNT; i++) {
-                game.animations[i].commandStream = NULL;
+        //wait for player to press a key
+        screenState.frame = 0;
+        while (1) {
+            TASK_SLEEP(1);
+            if (screenState.frame & 16) {
+                sprites[player.spriteIndex[SPR_INDEX_PLAYER]].x = SPR_OFF;
+
+            } else {
+                sprites[player.spriteIndex[SPR_INDEX_PLAYER]].x = player.x[SPR_INDEX_PLAYER] >> 8;
             }
+            screenState.frame++;
+            if (ReadInputPresses() != 0)
+                break;
+        }
+        SeedRandom(screenState.frame);
 
-            UnpackGameMap(game.level);
-            FadeIn(3, false);
+        if ((saveGame.playedLevels[game.level / 8] & (1 << (game.level % 8))) == 0) {
+
+            saveGame.playedLevels[game.level / 8] |= (1 << (game.level % 8));
+            game.saveDirty = true;
+        }
 
-            //wait for player to press a key
-            u16 frame = 0;
-            while (1) {
-                WaitVsync(1);
-                if (frame & 16) {
-                    sprites[player[SPR_INDEX_PLAYER].spriteIndex].x = SPR_OFF;
+        sprites[player.spriteIndex[SPR_INDEX_PLAYER]].x = player.x[SPR_INDEX_PLAYER] >> 8;
 
-                } else {
-                    sprites[player[SPR_INDEX_PLAYER].spriteIndex].x = player[SPR_INDEX_PLAYER].x >> 8;
-                }
-                frame++;
-                if (ReadJoypad(0) != 0)
+        //main game loop
+        game.pauseRequested = false;
+        do {
+            TASK_YIELD();
+            //a tick for each vsync since the last frame, the game keeps its
+            //speed when a frame overruns
+            for (u8 tick = scheduler.ticks; tick > 0; tick--) {
+                GameFrame();
+                if (game.pauseRequested || player.died[SPR_INDEX_PLAYER] || game.levelComplete)
                     break;
             }
-            srand(frame);
+            if (game.pauseRequested) {
+                game.pauseRequested = false;
+                CallScreen(TASK_PAUSE);
+                TASK_YIELD();
+            }
+        } while (!player.died[SPR_INDEX_PLAYER] && !game.levelComplete && !game.levelQuit && !game.levelRestart);
 
-            if ((saveGame.playedLevels[game.level / 8] & (1 << (game.level % 8))) == 0) {
+        TriggerFx(99, SFX_VOLUME, false); //stop falling sound
+        FadeOut(4, true);
+        hideAllSprites();
+        ClearVram();
 
-                saveGame.playedLevels[game.level / 8] |= (1 << (game.level % 8));
-                saveEeprom();
+        if (game.levelComplete) {
+            if (player.died[SPR_INDEX_PLAYER] == true) {
+                player.lives[SPR_INDEX_PLAYER]--;
             }
 
-            sprites[player[SPR_INDEX_PLAYER].spriteIndex].x = player[SPR_INDEX_PLAYER].x >> 8;
-
-            //main game loop
-            do {
-                WaitVsync(1);
+            //mark level as completed in savegame
+            saveGame.completedLevels[game.level / 8] |= 1 << (game.level % 8);
 
-                //update player & enemies
-                for (u8 id = 0; id < MAX_PLAYERS; id++) {
-                    ProcessPlayer(id);
-                }
+            game.level++;
+            game.saveDirty = true;
+        }
 
-                ProcessGold();
-                ProcessAnimations();
+    } while ((game.level < LEVELS_COUNT && !game.levelQuit) || game.levelRestart);
 
-            } while (!player[SPR_INDEX_PLAYER].died && !game.levelComplete && !game.levelQuit && !game.levelRestart);
+    //SetSpriteVisibility(false);
+    hideAllSprites();
+    ClearVram();
 
-            TriggerFx(99, SFX_VOLUME, false); //stop falling sound
-            FadeOut(4, true);
-            hideAllSprites();
-            ClearVram();
+    StartScreen(game.levelQuit ? TASK_TITLE : TASK_GAME_OVER);
+    TASK_END();
+}
 
-            if (game.levelComplete) {
-                if (player[SPR_INDEX_PLAYER].died == true) {
-                    player[SPR_INDEX_PLAYER].lives--;
-                }
+uint8_t GameOverTask() {
+    TASK_BEGIN(TASK_GAME_OVER);
 
-                //mark level as completed in savegame
-                saveGame.completedLevels[game.level / 8] |= 1 << (game.level % 8);
+    if (player.lives[SPR_INDEX_PLAYER] > 0) {
+        Print(7, 5, "CONGRATULATIONS!");
+    }
 
-                game.level++;
-                saveEeprom();
-            }
+    Print(10, 9, "GAME OVER");
+    FadeIn(4, true);
 
-        } while ((game.level < LEVELS_COUNT && !game.levelQuit) || game.levelRestart);
+    TASK_WAIT_UNTIL(ReadInputPresses() != 0);
+    TASK_WAIT_UNTIL(InputState() == 0);
+    FlushInput();
 
-        //SetSpriteVisibility(false);
-        hideAllSprites();
-        ClearVram();
+    StartScreen(TASK_TITLE);
+    TASK_END();
+}
 
-        if (!game.levelQuit) {
+//writes the save game back in a frame with time to spare, an EEPROM write
+//takes longer than what is left of a gameplay frame
+uint8_t SaveTask() {
+    TASK_BEGIN(TASK_SAVE);
 
-            if (player[SPR_INDEX_PLAYER].lives > 0) {
-                Print(7, 5, "CONGRATULATIONS!");
-            }
+    TASK_WAIT_UNTIL(game.saveDirty);
+    game.saveDirty = false;
+    saveEeprom();
 
-            Print(10, 9, "GAME OVER");
-            FadeIn(4, true);
+    TASK_END();
+}
 
-            while (ReadJoypad(0) == 0)
-                ;
-            while (ReadJoypad(0) != 0)
-                ;
+//one frame of gameplay, also run headless by the host tools
+void GameFrame() {
+    PROFILE_BEGIN(PROFILE_GAME_FRAME);
+    ReceiveAiCommands();
 
-        }
+    //update player & enemies
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        PROFILE_BEGIN(PROFILE_PROCESS_PLAYER);
+        ProcessPlayer(id);
+        PROFILE_END(PROFILE_PROCESS_PLAYER);
     }
+
+    PROFILE_BEGIN(PROFILE_PROCESS_GOLD);
+    ProcessGold();
+    PROFILE_END(PROFILE_PROCESS_GOLD);
+    PROFILE_BEGIN(PROFILE_PROCESS_ANIMATIONS);
+    ProcessAnimations();
+    ProcessHoles();
+    game.animFrame++;
+    PROFILE_END(PROFILE_PROCESS_ANIMATIONS);
+
+    //the ai cog plans the next moves while this cog waits for vsync
+    PublishAiWorld();
+    PROFILE_END(PROFILE_GAME_FRAME);
 }
 
 void hideAllSprites() {
@@ -391,94 +842,103 @@ void hideAllSprites() {
     }
 }
 
+//rolls the two bottom rows one tile to the left
 void RollMenu() {
-    u8 c;
-    for (u8 j = 0; j < 30; j++) {
-        c = vram[(VRAM_TILES_H * 16)];
-        for (u8 i = 0; i < 60; i++) {
-            vram[(VRAM_TILES_H * 16) + i] = vram[(VRAM_TILES_H * 16) + i + 1];
-        }
-        vram[(VRAM_TILES_H * 17) + 29] = c;
-        WaitVsync(1);
+    u8 c = vram[(VRAM_TILES_H * 16)];
+
+    for (u8 i = 0; i < 59; i++) {
+        vram[(VRAM_TILES_H * 16) + i] = vram[(VRAM_TILES_H * 16) + i + 1];
     }
+    vram[(VRAM_TILES_H * 17) + 29] = c;
 }
 
-void PauseMenu() {
+//pause menu, rolled in over the status line, run over the level task
+uint8_t PauseTask() {
     u16 joy;
-    u8 option = 0, pos = 3;
 
+    TASK_BEGIN(TASK_PAUSE);
+
+    screenState.option = 0;
+    screenState.cursor = 3;
     Print(4, 17, "CONTINUE  RESTART  QUIT");
     TriggerFx(FX_PAUSE, SFX_VOLUME, false);
-    RollMenu();
-    SetTile(pos, 16, TILE_CURSOR);
-    while (ReadJoypad(0) != 0)
-        ;
+    for (screenState.step = 0; screenState.step < 30; screenState.step++) {
+        RollMenu();
+        TASK_SLEEP(1);
+    }
+    SetTile(screenState.cursor, 16, TILE_CURSOR);
+    FlushInput();
 
     while (1) {
-        WaitVsync(1);
-        joy = ReadJoypad(0);
-        if (joy != 0) {
+        TASK_SLEEP(1);
+        joy = GetInputEvent();
+        if ((joy & INPUT_KIND) == INPUT_PRESS) {
+            joy &= INPUT_BUTTONS;
             if (joy == BTN_RIGHT || joy == BTN_SELECT) {
-                if (option == 2) {
-                    option = 0;
+                if (screenState.option == 2) {
+                    screenState.option = 0;
                 } else {
-                    option++;
+                    screenState.option++;
                 }
             } else if (joy == BTN_LEFT) {
-                if (option == 0) {
-                    option = 2;
+                if (screenState.option == 0) {
+                    screenState.option = 2;
                 } else {
-                    option--;
+                    screenState.option--;
                 }
             } else if (joy == BTN_START || joy == BTN_A) {
-                if (option == 1)
+                if (screenState.option == 1)
                     game.levelRestart = true;
-                if (option == 2)
+                if (screenState.option == 2)
                     game.levelQuit = true;
                 break;
             }
             TriggerFx(13, SFX_VOLUME, true);
-            SetTile(pos, 16, TILE_BLACK);
-            if (option == 0)
-                pos = 3;
-            if (option == 1)
-                pos = 13;
-            if (option == 2)
-                pos = 22;
-            SetTile(pos, 16, TILE_CURSOR);
-            while (ReadJoypad(0) != 0)
-                ;
+            SetTile(screenState.cursor, 16, TILE_BLACK);
+            if (screenState.option == 0)
+                screenState.cursor = 3;
+            if (screenState.option == 1)
+                screenState.cursor = 13;
+            if (screenState.option == 2)
+                screenState.cursor = 22;
+            SetTile(screenState.cursor, 16, TILE_CURSOR);
         }
     }
 
-    while (ReadJoypad(0) != 0)
-        ;
-    if (option == 0) {
-        SetTile(pos, 16, TILE_BLACK);
-        RollMenu();
+    TASK_WAIT_UNTIL(InputState() == 0);
+    FlushInput();
+    if (screenState.option == 0) {
+        SetTile(screenState.cursor, 16, TILE_BLACK);
+        for (screenState.step = 0; screenState.step < 30; screenState.step++) {
+            RollMenu();
+            TASK_SLEEP(1);
+        }
     }
+
+    TASK_END();
 }
 
 void ProcessPlayer(uint8_t id) {
     unsigned int joy = 0;
 
-    if (!player[id].active)
+    if (!player.active[id])
         return;
 
-    u8 x = player[id].x >> 8;
-    u8 y = player[id].y >> 8;
+    u8 x = player.x[id] >> 8;
+    u8 y = player.y[id] >> 8;
 
-    player[id].tileAtFeet = GetTileAtFeet(x, y);
-    player[id].tileAtHead = GetTileAtHead(x, y);
-    player[id].tileUnder = GetTileUnder(x, y);
+    //only look the tiles up again when crossing a tile boundary
+    if (!IsTileCacheValid(id, x, y)) {
+        UpdateTileCache(id, x, y);
+    }
 
     if (id >= SPR_INDEX_PLAYER) {
 
-        joy = ReadJoypad(0);
+        joy = ReadGameInput();
 
         //pause game
         if (joy & BTN_START) {
-            PauseMenu();
+            game.pauseRequested = true;
             return;
         }
 
@@ -492,39 +952,43 @@ void ProcessPlayer(uint8_t id) {
                 if ((x + 4) >= gx && (x + 2) <= (gx + TILE_WIDTH) && y >= gy && y <= (gy + TILE_HEIGHT)) {
                     game.gold[i].state = GOLD_STATE_COLLECTED;
                     game.goldCollected++;
-                    SetTile(game.gold[i].x, game.gold[i].y, TILE_BG);
+                    SetFieldTile(game.gold[i].x, game.gold[i].y, TILE_BG);
                     TriggerFx(0, SFX_VOLUME, false);
                     UpdateInfo();
                 }
             }
         }
 
-        //check if player died crushed in a brick
-        if (player[id].tileAtFeet == TILE_BREAKABLE) {
-            player[id].action = ACTION_DIE;
+        //bricks filling back are checked by ProcessHoles, this catches a move
+        //that ends inside a brick
+        if (TILE_HAS(player.tileAtFeet[id], TILE_FLAG_DEADLY)) {
+            player.action[id] = ACTION_DIE;
         } else {
 
             //check if player collided with enemies
             for (u8 i = 0; i < SPR_INDEX_PLAYER; i++) {
-                if (player[i].active) {
-                    gx = player[i].x >> 8;
-                    gy = player[i].y >> 8;
+                if (player.active[i]) {
+                    gx = player.x[i] >> 8;
+                    gy = player.y[i] >> 8;
 
                     if ((x + 4) >= gx && (x + 2) <= (gx + TILE_WIDTH) && y >= gy && y <= (gy + TILE_HEIGHT - 1)) {
-                        player[id].action = ACTION_DIE;
+                        player.action[id] = ACTION_DIE;
                     }
                 }
             }
         }
 
     } else {
-        if (player[id].action != ACTION_FALL || player[id].action != ACTION_DIE || player[id].action != ACTION_RESPAWN || player[id].action != ACTION_INHOLE) {
-            joy = ProcessEnemy(id);
+        //gold carried in any state, commands only when it can act
+        PROFILE_BEGIN(PROFILE_PROCESS_ENEMY);
+        ProcessEnemy(id);
+        PROFILE_END(PROFILE_PROCESS_ENEMY);
+        if (IS_ACTION_COMMANDED(player.action[id])) {
+            joy = player.aiButtons[id];
         }
-
     }
 
-    switch (player[id].action) {
+    switch (player.action[id]) {
         case ACTION_WALK:
 
             if (joy & BTN_A) {
@@ -538,12 +1002,12 @@ void ProcessPlayer(uint8_t id) {
                 Walk(id, -1);
 
             } else if (joy & BTN_UP) {
-                if (player[id].tileAtFeet == TILE_LADDER) {
+                if (player.tileAtFeet[id] == TILE_LADDER) {
                     Climb(id, -1);
                 }
 
             } else if (joy & BTN_DOWN) {
-                if (player[id].tileUnder == TILE_LADDER || player[id].tileAtFeet == TILE_LADDER) {
+                if (player.tileUnder[id] == TILE_LADDER || player.tileAtFeet[id] == TILE_LADDER) {
                     Climb(id, 1);
                 }
             }
@@ -601,239 +1065,229 @@ void ProcessPlayer(uint8_t id) {
     }
 }
 
-uint16_t ProcessEnemy(uint8_t id) {
-
-    if (player[id].action == ACTION_RESPAWN)
-        return ACTION_NONE;
+void ProcessEnemy(uint8_t id) {
 
-    u8 x = player[id].x >> 8;
-    u8 y = player[id].y >> 8;
+    if (player.action[id] == ACTION_RESPAWN)
+        return;
 
-    //check if dead
-    if (player[id].tileAtFeet == TILE_BREAKABLE) {
-        player[id].action = ACTION_RESPAWN;
-        return ACTION_NONE;
-    }
+    u8 x = player.x[id] >> 8;
+    u8 y = player.y[id] >> 8;
 
     //Grab gold
-    if (player[id].capturedGoldId == -1 && IsTileGold(player[id].tileAtFeet)) {
+    if (player.capturedGoldId[id] == -1 && IsTileGold(player.tileAtFeet[id])) {
 
         //Find gold at location (x,y);
         s8 goldId = -1;
         for (u8 i = 0; i < game.goldCount; i++) {
-            if (game.gold[i].x == ((x + 4) / TILE_WIDTH) && game.gold[i].y == (y / TILE_HEIGHT)) {
+            if (game.gold[i].state == GOLD_STATE_VISIBLE && game.gold[i].x == ((x + 4) >> 3) && game.gold[i].y == TILE_ROW(y)) {
                 goldId = i;
                 break;
             }
         }
 
-        if (goldId != player[id].lastCapturedGoldId) {
+        //a falling or misaligned enemy sees the gold under its feet one row
+        //below TILE_ROW(y), it is grabbed on a later frame once aligned
+        if (goldId != -1 && goldId != player.lastCapturedGoldId[id]) {
             game.gold[goldId].state = GOLD_STATE_CAPTURED;
-            player[id].capturedGoldId = goldId;
-            player[id].capturedGoldDelay = (rand() % 500) + 120;
-            SetTile(((x + 4) >> 3), (y / TILE_HEIGHT), TILE_BG);
+            player.capturedGoldId[id] = goldId;
+            player.capturedGoldDelay[id] = RandomRange(&rng.gold[id], 500) + 120;
+            SetFieldTile(((x + 4) >> 3), TILE_ROW(y), TILE_BG);
         }
 
         //release gold
-    } else if (player[id].capturedGoldId != -1 && player[id].capturedGoldDelay == 0 && player[id].action == ACTION_WALK
-        && player[id].tileAtFeet == TILE_BG && IsTileSolid(player[id].tileUnder, id)) {
+    } else if (player.capturedGoldId[id] != -1 && player.capturedGoldDelay[id] == 0 && player.action[id] == ACTION_WALK
+        && player.tileAtFeet[id] == TILE_BG && IsTileSolid(player.tileUnder[id], id)) {
 
-        game.gold[player[id].capturedGoldId].state = GOLD_STATE_VISIBLE;
-        game.gold[player[id].capturedGoldId].x = ((x + 4) / TILE_WIDTH);
-        game.gold[player[id].capturedGoldId].y = (y / TILE_HEIGHT);
-        player[id].lastCapturedGoldId = player[id].capturedGoldId;
-        player[id].capturedGoldId = -1;
+        GAME_CHECK(player.capturedGoldId[id] < game.goldCount);
+        game.gold[player.capturedGoldId[id]].state = GOLD_STATE_VISIBLE;
+        game.gold[player.capturedGoldId[id]].x = ((x + 4) >> 3);
+        game.gold[player.capturedGoldId[id]].y = TILE_ROW(y);
+        SetFieldTile(((x + 4) >> 3), TILE_ROW(y), TILE_GOLD1 + game.goldAnimFrame);
+        player.lastCapturedGoldId[id] = player.capturedGoldId[id];
+        player.capturedGoldId[id] = -1;
 
         //decrease gold release delay
-    } else if (player[id].capturedGoldId != -1 && player[id].capturedGoldDelay > 0) {
+    } else if (player.capturedGoldId[id] != -1 && player.capturedGoldDelay[id] > 0) {
 
-        player[id].capturedGoldDelay--;
+        player.capturedGoldDelay[id]--;
     }
-
-    return Ai(id);
 }
 
 void InHole(uint8_t id) {
-    if (player[id].lastAction != ACTION_INHOLE) {
-        player[id].action = ACTION_INHOLE;
-        player[id].frame = 0;
-
-        if (player[id].capturedGoldId != -1) {
-            game.gold[player[id].capturedGoldId].state = GOLD_STATE_VISIBLE;
-            game.gold[player[id].capturedGoldId].x = (player[id].x >> (8 + 3));
-            game.gold[player[id].capturedGoldId].y = ((player[id].y >> 8) / TILE_HEIGHT) - 1;
-            player[id].capturedGoldId = -1;
-            player[id].lastCapturedGoldId = -1;
-            player[id].capturedGoldDelay = 0;
+    if (player.lastAction[id] != ACTION_INHOLE) {
+        player.action[id] = ACTION_INHOLE;
+        player.frame[id] = 0;
+
+        if (player.capturedGoldId[id] != -1) {
+            GAME_CHECK(player.capturedGoldId[id] < game.goldCount);
+            game.gold[player.capturedGoldId[id]].state = GOLD_STATE_VISIBLE;
+            game.gold[player.capturedGoldId[id]].x = (player.x[id] >> (8 + 3));
+            game.gold[player.capturedGoldId[id]].y = TILE_ROW(player.y[id] >> 8) - 1;
+            SetFieldTile(game.gold[player.capturedGoldId[id]].x, game.gold[player.capturedGoldId[id]].y, TILE_GOLD1 + game.goldAnimFrame);
+            player.capturedGoldId[id] = -1;
+            player.lastCapturedGoldId[id] = -1;
+            player.capturedGoldDelay[id] = 0;
         }
         TriggerFx(5, 0x50, true);
-    }
-
-    u8 x = (player[id].x >> 8);
-    u8 y = (player[id].y >> 8);
-    u8 frame = player[id].frame;
 
-    if (frame == 150) {
-        TriggerAnimation(anim_getout_of_hole, x, y, player[id].spriteIndex);
-
-    } else if (frame == 170) {
-        player[id].x += 0;
-        player[id].y -= 0x200;
-
-    } else if (frame == 175) {
-        player[id].x += 0x100 * player[id].dir;
-        player[id].y -= 0x300;
-
-    } else if (frame == 180) {
-        player[id].x += 0x200 * player[id].dir;
-        player[id].y -= 0x300;
-
-    } else if (frame >= 185) {
-        player[id].x += 0x300 * player[id].dir;
-        player[id].y -= 0x400;
-
-        player[id].action = ACTION_WALK;
-        sprites[player[id].spriteIndex].flags = (player[id].dir == 1 ? 0 : SPRITE_FLIP_X);
+        //anim_inhole moves the enemy out of the hole and ends with ANIM_EVENT_LEAVE_HOLE
+        player.animSlot[id] = TriggerAnimation(anim_inhole, player.x[id] >> 8, player.y[id] >> 8, player.spriteIndex[id], id);
     }
 
-    sprites[player[id].spriteIndex].x = (player[id].x) >> 8;
-    sprites[player[id].spriteIndex].y = (player[id].y) >> 8;
+    player.lastAction[id] = ACTION_INHOLE;
+}
 
-    player[id].frame++;
-    player[id].lastAction = ACTION_INHOLE;
+//invoked by ANIM_CMD_EVENT on the owner of the animation
+void AnimationEvent(uint8_t id, uint8_t event) {
+    switch (event) {
+        case ANIM_EVENT_FIRE_DONE:
+            if (player.action[id] == ACTION_FIRE) {
+                player.action[id] = ACTION_WALK;
+                player.lastAction[id] = ACTION_NONE;
+                sprites[player.spriteIndex[id]].tileIndex = playerWalkFrames[0];
+            }
+            break;
 
+        case ANIM_EVENT_LEAVE_HOLE:
+            player.action[id] = ACTION_WALK;
+            player.animSlot[id] = ANIMATION_NONE;
+            LeaveHole(id);
+            sprites[player.spriteIndex[id]].flags = (player.dir[id] == 1 ? 0 : SPRITE_FLIP_X);
+            break;
+    }
 }
 
 void Die(uint8_t id) {
-    if (player[id].lastAction != ACTION_DIE) {
-        player[id].frame = 0;
-        player[id].lastAction = ACTION_DIE;
+    if (player.lastAction[id] != ACTION_DIE) {
+        player.frame[id] = 0;
+        player.lastAction[id] = ACTION_DIE;
         TriggerFx(99, SFX_VOLUME, false); //stop falling sound
         TriggerFx(4, 0xff, true);
     }
 
-    player[id].frame++;
-    if (player[id].frame & 8) {
-        sprites[player[id].spriteIndex].x = SPR_OFF;
+    player.frame[id]++;
+    if (player.frame[id] & 8) {
+        sprites[player.spriteIndex[id]].x = SPR_OFF;
         //player[id].
     } else {
-        sprites[player[id].spriteIndex].x = player[id].x >> 8;
+        sprites[player.spriteIndex[id]].x = player.x[id] >> 8;
     }
-    if (player[id].frame == 90) {
-        player[id].died = true;
+    if (player.frame[id] == 90) {
+        player.died[id] = true;
     }
 }
 
 void Respawn(uint8_t id) {
-    if (player[id].lastAction != ACTION_RESPAWN) {
-        player[id].frame = 0;
-        player[id].lastAction = ACTION_RESPAWN;
+    if (player.lastAction[id] != ACTION_RESPAWN) {
+        player.frame[id] = 0;
+        player.lastAction[id] = ACTION_RESPAWN;
     }
 
-    player[id].frame++;
+    player.frame[id]++;
 
-    if (player[id].frame == 20) {
+    if (player.frame[id] == 20) {
         u16 respawnX;
 
         //do{
-        respawnX = ((rand() % 28) + 1) * TILE_WIDTH;
-        //}while(IsTileBlocking(GetTileAtFeet(respawnX,player[id].y>>3)));
+        respawnX = (RandomRange(&rng.respawn, 28) + 1) * TILE_WIDTH;
+        //}while(IsTileBlocking(GetTileAtFeet(respawnX,player.y[id]>>3)));
 
-        player[id].y = 5;
-        player[id].x = respawnX << 8;
+        player.y[id] = 5;
+        player.x[id] = respawnX << 8;
 
         //PrintHexByte(1,6,respawnX);
 
-        sprites[player[id].spriteIndex].x = respawnX;
-        sprites[player[id].spriteIndex].y = 0;
-        sprites[player[id].spriteIndex].tileIndex = SPR_EXIT1 + (id < SPR_INDEX_PLAYER ? SPR_ENEMY_OFFSET : 0);
+        sprites[player.spriteIndex[id]].x = respawnX;
+        sprites[player.spriteIndex[id]].y = 0;
+        sprites[player.spriteIndex[id]].tileIndex = SPR_EXIT1 + player.spriteBase[id];
 
-    } else if (player[id].frame == 40) {
+    } else if (player.frame[id] == 40) {
 
-        player[id].action = ACTION_FALL;
+        //inside a brick of the top row another column is drawn on the next frame
+        if (TILE_HAS(GetTileAtFeet(player.x[id] >> 8, player.y[id] >> 8), TILE_FLAG_DEADLY)) {
+            player.frame[id] = 19;
+        } else {
+            player.action[id] = ACTION_FALL;
+        }
     }
 }
 
 void Fire(uint8_t id) {
-    if (player[id].lastAction != ACTION_FIRE) {
-        player[id].frame = 0;
-        player[id].action = ACTION_FIRE;
-        player[id].lastAction = ACTION_FIRE;
+    if (player.lastAction[id] != ACTION_FIRE) {
+        player.frame[id] = 0;
+        player.action[id] = ACTION_FIRE;
+        player.lastAction[id] = ACTION_FIRE;
 
-        u8 playerX = player[id].x >> 8;
-        u8 playerY = player[id].y >> 8;
-        s8 checkDisp = player[id].dir == 1 ? 8 : -8;
+        u8 playerX = player.x[id] >> 8;
+        u8 playerY = player.y[id] >> 8;
+        s8 checkDisp = player.dir[id] == 1 ? 8 : -8;
 
         if (IsTileBlocking(GetTileAtFeet(playerX + checkDisp, playerY))) {
-            player[id].action = ACTION_WALK;
+            player.action[id] = ACTION_WALK;
+            player.lastAction[id] = ACTION_NONE;
             return;
         }
 
-        if (player[id].dir == 1 && GetTileUnder(playerX + checkDisp, playerY) == TILE_BREAKABLE && !IsTileGold(GetTileAtFeet(playerX + checkDisp, playerY))) {
-            TriggerAnimation(anim_destroyBrick, (playerX + 12) >> 3, (playerY / TILE_HEIGHT) + 1, 0);
+        if (player.dir[id] == 1 && GetTileUnder(playerX + checkDisp, playerY) == TILE_BREAKABLE && !IsTileGold(GetTileAtFeet(playerX + checkDisp, playerY))) {
+            DigHole((playerX + 12) >> 3, TILE_ROW(playerY) + 1);
 
-        } else if (player[id].dir == -1 && GetTileUnder(playerX + checkDisp, playerY) == TILE_BREAKABLE && !IsTileGold(GetTileAtFeet(playerX + checkDisp, playerY))) {
-            TriggerAnimation(anim_destroyBrick, (playerX - 4) >> 3, (playerY / TILE_HEIGHT) + 1, 0);
+        } else if (player.dir[id] == -1 && GetTileUnder(playerX + checkDisp, playerY) == TILE_BREAKABLE && !IsTileGold(GetTileAtFeet(playerX + checkDisp, playerY))) {
+            DigHole((playerX - 4) >> 3, TILE_ROW(playerY) + 1);
 
         } else if (GetTileUnder(playerX + checkDisp, playerY) != TILE_UNBREAKABLE) {
-            player[id].action = ACTION_WALK;
+            player.action[id] = ACTION_WALK;
+            player.lastAction[id] = ACTION_NONE;
             return;
         }
 
-        sprites[player[id].spriteIndex].tileIndex = SPR_FIRE;
-        sprites[player[id].spriteIndex + 1].flags = (player[id].dir == 1 ? 0 : SPRITE_FLIP_X);
+        sprites[player.spriteIndex[id]].tileIndex = SPR_FIRE;
+        sprites[player.spriteIndex[id] + 1].flags = (player.dir[id] == 1 ? 0 : SPRITE_FLIP_X);
 
         TriggerFx(2, 0xff, true);
-        TriggerAnimation(anim_fire, playerX + (player[id].dir == 1 ? 8 : -8), playerY, player[id].spriteIndex + 1);
-    }
-
-    player[id].frame++;
-    if (player[id].frame == 25) {
-        player[id].action = ACTION_WALK;
-        player[id].lastAction = ACTION_NONE;
-        sprites[player[id].spriteIndex].tileIndex = playerWalkFrames[0];
+        //anim_fire gives back control with ANIM_EVENT_FIRE_DONE
+        TriggerAnimation(anim_fire, playerX + (player.dir[id] == 1 ? 8 : -8), playerY, player.spriteIndex[id] + 1, id);
     }
-
 }
 
 void Cling(uint8_t id, int8_t dir) {
 
-    if (player[id].lastAction != ACTION_CLING) {
-        player[id].frame = 0;
+    if (player.lastAction[id] != ACTION_CLING) {
+        player.frame[id] = 0;
     }
 
-    player[id].dir = dir;
-    player[id].action = ACTION_CLING;
+    player.dir[id] = dir;
+    player.action[id] = ACTION_CLING;
 
-    s32 newX = (player[id].x + (player[id].playerSpeed * dir)) >> 8;
-    u8 newY = player[id].y >> 8;
+    s16 newX = (player.x[id] + (player.playerSpeed[id] * dir)) >> 8;
+    u8 newY = player.y[id] >> 8;
 
     //check if player is not blocked by screen limit or a wall
     if ((newX >= 0 && newX < (SCREEN_TILES_H * TILE_WIDTH)) && !IsTileBlocking(GetTileOnSide(newX, newY, dir))) {
 
-        player[id].x += (player[id].playerSpeed * dir);
-        player[id].frame += player[id].frameSpeed;
-        if ((player[id].frame) >> 4 >= (sizeof playerClingFrames))
-            player[id].frame = 0;
+        player.x[id] += (player.playerSpeed[id] * dir);
+        player.frame[id] += player.frameSpeed[id];
+        if ((player.frame[id]) >> 4 >= (sizeof playerClingFrames))
+            player.frame[id] = 0;
 
-        if (GetTileAtHead(newX, newY) != TILE_ROPE) {
-            player[id].action = ACTION_WALK;
+        u8 tileAtHead = IsTileCacheValid(id, newX, newY) ? player.tileAtHead[id] : GetTileAtHead(newX, newY);
+        if (tileAtHead != TILE_ROPE) {
+            player.action[id] = ACTION_WALK;
         }
 
     } else {
         //blocked!
     }
 
-    sprites[player[id].spriteIndex].tileIndex = playerClingFrames[(player[id].frame) >> 4] + (id < SPR_INDEX_PLAYER ? SPR_ENEMY_OFFSET : 0);
-    sprites[player[id].spriteIndex].flags = (player[id].dir == 1 ? 0 : SPRITE_FLIP_X);
-    sprites[player[id].spriteIndex].x = (player[id].x) >> 8;
-    sprites[player[id].spriteIndex].y = newY;
+    sprites[player.spriteIndex[id]].tileIndex = playerClingFrames[(player.frame[id]) >> 4] + player.spriteBase[id];
+    sprites[player.spriteIndex[id]].flags = (player.dir[id] == 1 ? 0 : SPRITE_FLIP_X);
+    sprites[player.spriteIndex[id]].x = (player.x[id]) >> 8;
+    sprites[player.spriteIndex[id]].y = newY;
 
-    player[id].lastAction = ACTION_CLING;
+    player.lastAction[id] = ACTION_CLING;
 }
 
 void EndFall(uint8_t id, uint8_t action) {
-    player[id].action = action;
+    player.action[id] = action;
     RoundYpos(id);
     if (id >= SPR_INDEX_PLAYER) {
         TriggerFx(99, SFX_VOLUME, false); //stop falling sound
@@ -841,10 +1295,10 @@ void EndFall(uint8_t id, uint8_t action) {
 }
 
 void Fall(uint8_t id) {
-    player[id].action = ACTION_FALL;
+    player.action[id] = ACTION_FALL;
 
     if (id >= SPR_INDEX_PLAYER) {
-        if (player[id].lastAction != ACTION_FALL) {
+        if (player.lastAction[id] != ACTION_FALL) {
             TriggerFx(3, SFX_VOLUME, false);
         } else {
             //mixer.channels.type.wave[0].step -= 16;
@@ -852,183 +1306,200 @@ void Fall(uint8_t id) {
         }
     }
 
-    u8 newX = player[id].x >> 8;
-    u8 newY = player[id].y >> 8;
+    u8 newX = player.x[id] >> 8;
+    u8 newY = player.y[id] >> 8;
 
-    u8 truncY = (newY / 12) * 12;
+    u8 truncY = TILE_ROW(newY) * TILE_HEIGHT;
 
     //check if an enemy and fell into a hole dug by the player
     if (id < SPR_INDEX_PLAYER && IsTileHole(GetTileAtFeet(newX, truncY))) {
-        player[id].action = ACTION_INHOLE;
+        s8 hole = HoleAt((newX + 4) >> 3, TILE_ROW(truncY));
+        if (hole != HOLE_NONE) {
+            game.holes[hole].occupant = id;
+        }
+        player.action[id] = ACTION_INHOLE;
         RoundYpos(id);
-        sprites[player[id].spriteIndex].y = truncY;
-        SetTile(newX / TILE_WIDTH, truncY / TILE_HEIGHT, TILE_BG_STEP_ON);
+        sprites[player.spriteIndex[id]].y = truncY;
+        SetFieldTile(newX >> 3, TILE_ROW(truncY), TILE_BG_STEP_ON);
         return;
     }
 
     //check if player has touched down on something
-    u8 tile = GetTileUnder(newX, newY);
+    u8 tile = IsTileCacheValid(id, newX, newY) ? player.tileUnder[id] : GetTileUnder(newX, newY);
     if (IsTileBlocking(tile)) {
-        u8 dir = player[id].dir;
+        u8 dir = player.dir[id];
         EndFall(id, ACTION_WALK);
         Walk(id, 0);
-        player[id].dir = dir;
+        player.dir[id] = dir;
         return;
     }
 
     //ugly hack so enemy does not get sticked on teh rope
-    if (player[id].lastAction == ACTION_CLING && player[id].playerSpeed < 0x100) {
-        player[id].y += 0x100;
+    if (player.lastAction[id] == ACTION_CLING && player.playerSpeed[id] < 0x100) {
+        player.y[id] += 0x100;
     }
 
-    player[id].y += (player[id].playerSpeed);
-    newY = player[id].y >> 8;
+    player.y[id] += (player.playerSpeed[id]);
+    newY = player.y[id] >> 8;
 
-    sprites[player[id].spriteIndex].tileIndex = SPR_FALL + (id < SPR_INDEX_PLAYER ? SPR_ENEMY_OFFSET : 0);
-    sprites[player[id].spriteIndex].flags = (player[id].dir == 1 ? 0 : SPRITE_FLIP_X);
-    sprites[player[id].spriteIndex].x = newX;
-    sprites[player[id].spriteIndex].y = newY;
+    sprites[player.spriteIndex[id]].tileIndex = SPR_FALL + player.spriteBase[id];
+    sprites[player.spriteIndex[id]].flags = (player.dir[id] == 1 ? 0 : SPRITE_FLIP_X);
+    sprites[player.spriteIndex[id]].x = newX;
+    sprites[player.spriteIndex[id]].y = newY;
 
     if (GetTileAtHead(newX, newY) == TILE_ROPE) {
-        if (newY % 12 == 0) {
+        if (newY == TILE_ROW(newY) * TILE_HEIGHT) {
             EndFall(id, ACTION_CLING);
-            player[id].lastAction = ACTION_CLING;
+            player.lastAction[id] = ACTION_CLING;
             return;
         }
     } else if (IsTileSolid(tile, id)) {
         EndFall(id, ACTION_WALK);
     }
 
-    player[id].lastAction = ACTION_FALL;
+    player.lastAction[id] = ACTION_FALL;
 }
 
 void Climb(uint8_t id, int8_t dir) {
     u8 y; //tileUnder,tileAtHead,tileAtFeet;
 
-    if (player[id].lastAction != ACTION_CLIMB) {
-        player[id].frame = 0;
-        if ((player[id].x >> (8 + 3)) < ((player[id].x + 0x400) >> (8 + 3))) {
+    if (player.lastAction[id] != ACTION_CLIMB) {
+        player.frame[id] = 0;
+        if ((player.x[id] >> (8 + 3)) < ((player.x[id] + 0x400) >> (8 + 3))) {
             //round X position to align to tile
-            player[id].x += 0x800;
-            player[id].x &= 0xf8ff;
+            player.x[id] += 0x800;
+            player.x[id] &= 0xf8ff;
         }
     }
 
-    player[id].action = ACTION_CLIMB;
-    player[id].dir = dir;
+    player.action[id] = ACTION_CLIMB;
+    player.dir[id] = dir;
 
-//  x=player[id].x>>8;
-    y = player[id].y >> 8;
+//  x=player.x[id]>>8;
+    y = player.y[id] >> 8;
 
     bool isLadder;
     if (dir == 1) {
         //if climbing down
-        isLadder = (player[id].tileAtHead == TILE_LADDER || player[id].tileUnder == TILE_LADDER);
+        isLadder = (player.tileAtHead[id] == TILE_LADDER || player.tileUnder[id] == TILE_LADDER);
     } else {
         //if climbing up
-        isLadder = (player[id].tileAtFeet == TILE_LADDER || player[id].tileAtHead == TILE_LADDER);
+        isLadder = (player.tileAtFeet[id] == TILE_LADDER || player.tileAtHead[id] == TILE_LADDER);
     }
 
     if (isLadder) {
 
-        if ((dir == -1 && !IsTileBlocking(player[id].tileAtHead)) || (dir == 1 && !IsTileBlocking(player[id].tileUnder))) {
+        if ((dir == -1 && !IsTileBlocking(player.tileAtHead[id])) || (dir == 1 && !IsTileBlocking(player.tileUnder[id]))) {
 
-            player[id].x = player[id].x & 0xf800;
+            player.x[id] = player.x[id] & 0xf800;
 
-            if ((dir == -1 && player[id].y > 3) || dir == 1)
-                player[id].y += (player[id].playerSpeed * dir);
+            if (dir == 1) {
+                player.y[id] += player.playerSpeed[id];
+            } else if (player.y[id] > 3) {
+                //y is unsigned, stop at the top of the screen
+                player.y[id] = (player.y[id] > player.playerSpeed[id]) ? player.y[id] - player.playerSpeed[id] : 0;
+            }
 
             //insure enemies doesn't reach the top of the screen
             if (id != SPR_INDEX_PLAYER && dir == -1 && y <= 4) {
-                player[id].dir = 1;
-                player[id].lastAiAction = AI_ACTION_CLIMB_DOWN;
+                player.dir[id] = 1;
 
                 //we have reached the exit!
-            } else if (id == SPR_INDEX_PLAYER && player[id].y <= 4 && game.goldCollected == game.goldCount) {
+            } else if (id == SPR_INDEX_PLAYER && player.y[id] <= 4 && game.goldCollected == game.goldCount) {
                 game.levelComplete = true;
                 return;
             }
 
-            player[id].frame += player[id].frameSpeed;
-            if ((player[id].frame) >> 4 >= sizeof playerClimbFrames)
-                player[id].frame = 0;
+            player.frame[id] += player.frameSpeed[id];
+            if ((player.frame[id]) >> 4 >= sizeof playerClimbFrames)
+                player.frame[id] = 0;
 
-            sprites[player[id].spriteIndex].tileIndex = playerClimbFrames[player[id].frame >> 4] + (id < SPR_INDEX_PLAYER ? SPR_ENEMY_OFFSET : 0);
-            sprites[player[id].spriteIndex].flags = ((player[id].frame >> 5) & 1) == 0 ? 0 : SPRITE_FLIP_X;
-            sprites[player[id].spriteIndex].x = player[id].x >> 8;
-            sprites[player[id].spriteIndex].y = player[id].y >> 8;
+            sprites[player.spriteIndex[id]].tileIndex = playerClimbFrames[player.frame[id] >> 4] + player.spriteBase[id];
+            sprites[player.spriteIndex[id]].flags = ((player.frame[id] >> 5) & 1) == 0 ? 0 : SPRITE_FLIP_X;
+            sprites[player.spriteIndex[id]].x = player.x[id] >> 8;
+            sprites[player.spriteIndex[id]].y = player.y[id] >> 8;
 
         } else {
-            player[id].action = ACTION_WALK;
+            player.action[id] = ACTION_WALK;
         }
 
     } else {
         //finished ladder
-        if (IsTileBG(player[id].tileUnder)) {
-            player[id].action = ACTION_FALL;
+        if (IsTileBG(player.tileUnder[id])) {
+            player.action[id] = ACTION_FALL;
         } else {
-            player[id].action = ACTION_WALK;
+            player.action[id] = ACTION_WALK;
         }
     }
 
-    player[id].lastAction = ACTION_CLIMB;
+    player.lastAction[id] = ACTION_CLIMB;
 
 }
 
 void Walk(uint8_t id, int8_t dir) {
 
     //"round corner" when exiting ladders
-    if (player[id].lastAction == ACTION_CLIMB) {
-        u16 tmp = ((player[id].y >> 8) / TILE_HEIGHT) * TILE_HEIGHT;
-        if (abs(tmp - (player[id].y >> 8)) <= 4) {
-            player[id].y = (tmp & 0xff) << 8;
+    if (player.lastAction[id] == ACTION_CLIMB) {
+        u16 tmp = TILE_ROW(player.y[id] >> 8) * TILE_HEIGHT;
+        if (abs(tmp - (player.y[id] >> 8)) <= 4) {
+            player.y[id] = (tmp & 0xff) << 8;
         }
     }
 
-    if (player[id].lastAction != ACTION_WALK) {
-        player[id].frame = 0;
+    if (player.lastAction[id] != ACTION_WALK) {
+        player.frame[id] = 0;
     }
 
-    player[id].dir = dir;
-    player[id].action = ACTION_WALK;
+    player.dir[id] = dir;
+    player.action[id] = ACTION_WALK;
 
-    s32 newX = (player[id].x + (player[id].playerSpeed * dir)) >> 8;
-    u8 newY = player[id].y >> 8;
-    u8 tileAtHead = GetTileAtHead(newX, newY);
-    u8 tileAtFeet = GetTileAtFeet(newX, newY);
+    s16 newX = (player.x[id] + (player.playerSpeed[id] * dir)) >> 8;
+    u8 newY = player.y[id] >> 8;
+    u8 tileAtHead, tileAtFeet, tileUnder;
+
+    //most steps stay inside the cached tile cell
+    if (IsTileCacheValid(id, newX, newY)) {
+        tileAtHead = player.tileAtHead[id];
+        tileAtFeet = player.tileAtFeet[id];
+        tileUnder = player.tileUnder[id];
+    } else {
+        tileAtHead = GetTileAtHead(newX, newY);
+        tileAtFeet = GetTileAtFeet(newX, newY);
+        tileUnder = GetTileUnder(newX, newY);
+    }
 
     //check if player is not blocked by screen limit or a wall
     if ((newX >= 0 && newX < (SCREEN_TILES_H * TILE_WIDTH)) && !IsTileBlocking(GetTileOnSide(newX, newY, dir))) {
 
-        player[id].x += (player[id].playerSpeed * dir);
-        player[id].frame += player[id].frameSpeed;
-        if ((player[id].frame) >> 4 >= (sizeof playerWalkFrames))
-            player[id].frame = 0;
+        player.x[id] += (player.playerSpeed[id] * dir);
+        player.frame[id] += player.frameSpeed[id];
+        if ((player.frame[id]) >> 4 >= (sizeof playerWalkFrames))
+            player.frame[id] = 0;
 
         if (tileAtHead == TILE_ROPE) {
-            player[id].action = ACTION_CLING;
+            player.action[id] = ACTION_CLING;
             RoundYpos(id);
         }
-        else if (!IsTileSolid(GetTileUnder(newX, newY), id) && tileAtFeet != TILE_LADDER) {
-            player[id].action = ACTION_FALL;
-            if ((player[id].x >> (8 + 3)) < ((player[id].x + 0x400) >> (8 + 3))) {
-                player[id].x += 0x800;
+        else if (!IsTileSolid(tileUnder, id) && tileAtFeet != TILE_LADDER) {
+            player.action[id] = ACTION_FALL;
+            if ((player.x[id] >> (8 + 3)) < ((player.x[id] + 0x400) >> (8 + 3))) {
+                player.x[id] += 0x800;
             }
-            player[id].x &= 0xf8ff;
+            player.x[id] &= 0xf8ff;
 
         }
 
     } else {
         //blocked!
         if (id < SPR_INDEX_PLAYER) {
-            player[id].dir = -player[id].dir;
+            player.dir[id] = -player.dir[id];
         }
     }
 
-    sprites[player[id].spriteIndex].tileIndex = playerWalkFrames[(player[id].frame) >> 4] + (id < SPR_INDEX_PLAYER ? SPR_ENEMY_OFFSET : 0);
-    sprites[player[id].spriteIndex].flags = (player[id].dir == 1 ? 0 : SPRITE_FLIP_X);
-    sprites[player[id].spriteIndex].x = (player[id].x) >> 8;
-    sprites[player[id].spriteIndex].y = newY;
+    sprites[player.spriteIndex[id]].tileIndex = playerWalkFrames[(player.frame[id]) >> 4] + player.spriteBase[id];
+    sprites[player.spriteIndex[id]].flags = (player.dir[id] == 1 ? 0 : SPRITE_FLIP_X);
+    sprites[player.spriteIndex[id]].x = (player.x[id]) >> 8;
+    sprites[player.spriteIndex[id]].y = newY;
 
-    player[id].lastAction = ACTION_WALK;
+    player.lastAction[id] = ACTION_WALK;
 }
@@ -17,71 +17,155 @@ void saveEeprom() {
 #endif
 }
 
+//fill the tables used by TILE_ROW and VRAM_ROW
+void InitTileTables() {
+    for (u16 i = 0; i < TILE_ROW_TABLE_SIZE; i++) {
+        tileRowTable[i] = (i * 4) / TILE_HEIGHT;
+    }
+    for (u8 i = 0; i < VRAM_ROW_TABLE_SIZE; i++) {
+        vramRowOffset[i] = i * VRAM_TILES_H;
+    }
+}
+
 uint8_t GetTileOnSide(uint8_t x, uint8_t y, int8_t dir) {
     int8_t disp = (dir == DIR_LEFT) ? 0 : 7;
-    return vram[((((y + ((TILE_HEIGHT) - 1)) / TILE_HEIGHT)) * VRAM_TILES_H) + ((x + disp) >> 3)]; // - RAM_TILES_COUNT;
+    return vram[VRAM_ROW(TILE_ROW(y + (TILE_HEIGHT - 1))) + ((x + disp) >> 3)]; // - RAM_TILES_COUNT;
 }
 
 uint8_t GetTileUnder(uint8_t x, uint8_t y) {
     if (y >= ((FIELD_HEIGHT - 1) * TILE_HEIGHT)) {
         return TILE_UNBREAKABLE;
     } else {
-        return vram[((((y + TILE_HEIGHT) / TILE_HEIGHT)) * VRAM_TILES_H) + ((x + 4) >> 3)]; // - RAM_TILES_COUNT;
+        return vram[VRAM_ROW(TILE_ROW(y) + 1) + ((x + 4) >> 3)]; // - RAM_TILES_COUNT;
     }
 }
 
 uint8_t GetTileAtFeet(uint8_t x, uint8_t y) {
-    return vram[((((y + (TILE_HEIGHT - 1)) / TILE_HEIGHT)) * VRAM_TILES_H) + ((x + 4) >> 3)]; // - RAM_TILES_COUNT;
+    return vram[VRAM_ROW(TILE_ROW(y + (TILE_HEIGHT - 1))) + ((x + 4) >> 3)]; // - RAM_TILES_COUNT;
 }
 
 uint8_t GetTileAtHead(uint8_t x, uint8_t y) {
-    return vram[((((y + 1) / TILE_HEIGHT)) * VRAM_TILES_H) + ((x + 4) >> 3)]; // - RAM_TILES_COUNT;
+    return vram[VRAM_ROW(TILE_ROW(y + 1)) + ((x + 4) >> 3)]; // - RAM_TILES_COUNT;
 }
 
-bool IsTileSolid(uint8_t tileId, uint8_t id) {
-    if (tileId == TILE_BREAKABLE || tileId == TILE_UNBREAKABLE || tileId == TILE_LADDER || tileId == TILE_BG_STEP_ON)
-        return true;
+//look up the tiles around the player and remember the y range they are valid for,
+//head, feet and under rows only change at the first, second and last line of a row
+void UpdateTileCache(uint8_t id, uint8_t x, uint8_t y) {
+    u8 row = TILE_ROW(y);
+    u8 top = row * TILE_HEIGHT;
+
+    player.tileAtFeet[id] = GetTileAtFeet(x, y);
+    player.tileAtHead[id] = GetTileAtHead(x, y);
+    player.tileUnder[id] = GetTileUnder(x, y);
+    player.cellX[id] = (x + 4) >> 3;
+    player.cellY[id] = row;
+
+    if (y == top || y == top + (TILE_HEIGHT - 1)) {
+        player.cellTop[id] = y;
+        player.cellBottom[id] = y;
+    } else {
+        player.cellTop[id] = top + 1;
+        player.cellBottom[id] = top + (TILE_HEIGHT - 2);
+    }
+}
 
-    if (tileId >= TILE_DESTROY1 && tileId <= TILE_DESTROY5) {
-        //check if there's an enemy in the hole so we can step on it's head
+//true if the cached tiles of the player are the ones at (x,y)
+bool IsTileCacheValid(uint8_t id, uint8_t x, uint8_t y) {
+    return ((x + 4) >> 3) == player.cellX[id] && y >= player.cellTop[id] && y <= player.cellBottom[id];
+}
 
-        u8 srcX = ((player[id].x >> 8) + 4) >> 3;
-        u8 srcY = (player[id].y >> 8) / TILE_HEIGHT;
-        u8 destX, destY;
+//SetTile for the play field, drops the tile cache of the players next to the tile
+void SetFieldTile(uint8_t x, uint8_t y, uint8_t tile) {
+    SetTile(x, y, tile);
+    SetAiCell(x, y, tile);
 
-        for (u8 i = 0; i < SPR_INDEX_PLAYER; i++) {
-            if (player[i].active && i < SPR_INDEX_PLAYER) { //enemies can fall in hole with player
-                destX = (player[i].x >> 8) >> 3;
-                destY = (player[i].y >> 8) / TILE_HEIGHT;
-                if (srcX == destX && (srcY + 1) == destY) {
-                    return true;
-                }
-            }
+    for (u8 i = 0; i < MAX_PLAYERS; i++) {
+        if (player.cellX[i] == x && (player.cellY[i] == y || player.cellY[i] + 1 == y)) {
+            player.cellX[i] = TILE_CELL_NONE;
         }
     }
+}
+
+bool IsTileSolid(uint8_t tileId, uint8_t id) {
+    if (TILE_HAS(tileId, TILE_FLAG_SOLID))
+        return true;
+
+    if (TILE_HAS(tileId, TILE_FLAG_HOLE)) {
+        //check if there's an enemy in the hole so we can step on it's head
+        s8 hole = HoleAt(((player.x[id] >> 8) + 4) >> 3, TILE_ROW(player.y[id] >> 8) + 1);
+        return (hole != HOLE_NONE && game.holes[hole].occupant != -1);
+    }
 
     return false;
 
 }
 
 bool IsTileBlocking(uint8_t tileId) {
-    return (tileId == TILE_BREAKABLE || tileId == TILE_UNBREAKABLE || tileId == TILE_BG_STEP_ON);
+    return TILE_HAS(tileId, TILE_FLAG_BLOCKING);
 }
 
 bool IsTileGold(uint8_t tileId) {
-    return (tileId == TILE_GOLD1 || tileId == TILE_GOLD2 || tileId == TILE_GOLD3 || tileId == TILE_GOLD4);
+    return TILE_HAS(tileId, TILE_FLAG_GOLD);
 }
 
 bool IsTileHole(uint8_t tileId) {
-    return (tileId == TILE_BG_HOLE || (tileId >= TILE_DESTROY1 && tileId <= TILE_DESTROY5));
+    return TILE_HAS(tileId, TILE_FLAG_HOLE);
 }
 
 bool IsTileBG(uint8_t tileId) {
-    return (tileId == TILE_BG || tileId == TILE_SHADOW);
+    return TILE_HAS(tileId, TILE_FLAG_BACKGROUND);
 }
 
 void RoundYpos(uint8_t id) {
-    player[id].y = (((player[id].y >> 8) / TILE_HEIGHT) * TILE_HEIGHT) << 8;
+    player.y[id] = (TILE_ROW(player.y[id] >> 8) * TILE_HEIGHT) << 8;
+}
+
+//seeds the random streams of the main cog, the ai cog seeds its own from the
+//next published world
+void SeedRandom(uint32_t seed) {
+    rng.seed = seed;
+    rng.respawn = RandomSeed(seed, RANDOM_RESPAWN);
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        rng.gold[id] = RandomSeed(seed, RANDOM_GOLD + id);
+    }
+}
+
+//initial state of stream 'stream' (murmur3 finalizer), never 0
+uint32_t RandomSeed(uint32_t seed, uint8_t stream) {
+    u32 x = seed + ((stream + 1) * 0x9e3779b9);
+
+    x = (x ^ (x >> 16)) * 0x85ebca6b;
+    x = (x ^ (x >> 13)) * 0xc2b2ae35;
+    x ^= x >> 16;
+    return x != 0 ? x : 0x2545f491;
+}
+
+//xorshift32
+uint32_t NextRandom(uint32_t *state) {
+    u32 x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+//uniform in [0, range) for range <= 65536 without a divide: the draw is masked
+//to the next power of 2 and drawn again when out of range (less than 2 draws
+//on average)
+uint16_t RandomRange(uint32_t *state, uint32_t range) {
+    u32 mask = range - 1;
+    u32 value;
+
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    do {
+        value = (NextRandom(state) >> 16) & mask;
+    } while (value >= range);
+    return value;
 }
 
 void ProcessGold() {
@@ -91,6 +175,8 @@ void ProcessGold() {
         //animate gold
         if (game.goldAnimSpeed > 10) {
 
+            //gold frames do not change any tile test so the tile caches are kept,
+            //released gold is drawn with SetFieldTile when dropped
             for (u8 i = 0; i < game.goldCount; i++) {
                 if (game.gold[i].state == GOLD_STATE_VISIBLE) {
                     SetTile(game.gold[i].x, game.gold[i].y, TILE_GOLD1 + game.goldAnimFrame);
@@ -106,21 +192,14 @@ void ProcessGold() {
 
         //check if all gold been collected and display exit ladders
         if (game.goldCollected == game.goldCount) {
-            u8 x, y, nibble, tile;
-            u16 pos = 0;
-            for (y = 0; y < 16; y++) {
-                for (x = 0; x < 28; x += 2) {
-                    for (nibble = 0; nibble < 2; nibble++) {
-                        if (nibble == 0) {
-                            tile = game.map[pos] >> 4;
-                        } else {
-                            tile = game.map[pos] & 0x0f;
-                        }
-                        if (tile == 6) {
-                            SetTile(x + nibble + 1, y, TILE_LADDER);
-                        }
+            u8 x, y, cells[LEVEL_ROW_CELLS];
+            const u8 *row;
+            for (y = 0; y < FIELD_HEIGHT; y++) {
+                row = DecodeMapRow(y, exitLadderTiles, cells);
+                for (x = 0; x < FIELD_WIDTH; x++) {
+                    if (row[x] != 0) {
+                        SetFieldTile(x + 1, y, row[x]);
                     }
-                    pos++;
                 }
             }
 
@@ -130,88 +209,277 @@ void ProcessGold() {
     }
 }
 
-//return -1 if no more animation slots available
-int8_t TriggerAnimation(const uint8_t* animation, uint8_t x, uint8_t y, uint8_t param1) {
-    //fin the next free animation slot
+//release all animation slots and holes
+void InitAnimations() {
     for (u8 i = 0; i < ANIMATION_SLOTS_COUNT; i++) {
-        if (game.animations[i].commandStream == NULL) {
-            game.animations[i].commandStream = animation;
-            game.animations[i].commandCount = 0;
-            game.animations[i].delay = 0;
-            game.animations[i].x = x;
-            game.animations[i].y = y;
-            game.animations[i].param1 = param1;
-            return i;
+        game.animations[i].commandStream = NULL;
+        game.animations[i].next = (i < ANIMATION_SLOTS_COUNT - 1) ? i + 1 : ANIMATION_NONE;
+    }
+    for (u8 i = 0; i < ANIMATION_WHEEL_SIZE; i++) {
+        game.animWheel[i] = ANIMATION_NONE;
+    }
+    game.animFree = 0;
+    game.animFrame = 0;
+    game.holeCount = 0;
+}
+
+//queue the animation in the wheel bucket of its wake up frame
+void ScheduleAnimation(int8_t slot) {
+    u8 bucket = game.animations[slot].wakeFrame & (ANIMATION_WHEEL_SIZE - 1);
+
+    game.animations[slot].next = game.animWheel[bucket];
+    game.animWheel[bucket] = slot;
+}
+
+//return -1 if no more animation slots available
+int8_t TriggerAnimation(const uint8_t* animation, uint8_t x, uint8_t y, uint8_t param1, int8_t owner) {
+    s8 i = game.animFree;
+
+    if (i == ANIMATION_NONE)
+        return -1;
+
+    game.animFree = game.animations[i].next;
+
+    game.animations[i].commandStream = animation;
+    game.animations[i].commandCount = 0;
+    game.animations[i].x = x;
+    game.animations[i].y = y;
+    game.animations[i].param1 = param1;
+    game.animations[i].loopCount = 0;
+    game.animations[i].owner = owner;
+
+    //start with the next ProcessAnimations call
+    game.animations[i].wakeFrame = game.animFrame;
+    ScheduleAnimation(i);
+
+    return i;
+}
+
+//stop an animation before the end of its stream
+void CancelAnimation(int8_t slot) {
+    s8 *link = &game.animWheel[game.animations[slot].wakeFrame & (ANIMATION_WHEEL_SIZE - 1)];
+
+    while (*link != ANIMATION_NONE) {
+        if (*link == slot) {
+            *link = game.animations[slot].next;
+            game.animations[slot].commandStream = NULL;
+            game.animations[slot].next = game.animFree;
+            game.animFree = slot;
+            return;
         }
+        link = &game.animations[*link].next;
     }
-    return -1;
 }
 
-//invoked once per frame
+//invoked once per frame before the clock advances, only visits the bucket of
+//the current frame
 void ProcessAnimations() {
     u8 x, y, command;
     bool complete;
+    s8 i, next, prev = ANIMATION_NONE, due = ANIMATION_NONE;
+    u16 now = game.animFrame;
+    u8 bucket = now & (ANIMATION_WHEEL_SIZE - 1);
+
+    //move the animations waking up this frame out of the bucket,
+    //the others are sleeping for more turns of the wheel
+    i = game.animWheel[bucket];
+    while (i != ANIMATION_NONE) {
+        next = game.animations[i].next;
+        if (game.animations[i].wakeFrame == now) {
+            if (prev == ANIMATION_NONE) {
+                game.animWheel[bucket] = next;
+            } else {
+                game.animations[prev].next = next;
+            }
+            game.animations[i].next = due;
+            due = i;
+        } else {
+            prev = i;
+        }
+        i = next;
+    }
 
-    for (u8 i = 0; i < ANIMATION_SLOTS_COUNT; i++) {
-        if (game.animations[i].commandStream != NULL) {
-            if (game.animations[i].delay > 0) {
-                game.animations[i].delay--;
+    while (due != ANIMATION_NONE) {
+        i = due;
+        due = game.animations[i].next;
+
+        const u8* ptr = game.animations[i].commandStream;
+        x = game.animations[i].x;
+        y = game.animations[i].y;
+        complete = false;
+
+        while (complete == false) {
+            command = *ptr++;
+
+            if (command & 0x80) {
+                //delay command, resume after (delay + 1) frames
+                game.animations[i].wakeFrame = now + (command & 0x7f) + 1;
+                ScheduleAnimation(i);
+                complete = true;
             } else {
-                const u8* ptr = game.animations[i].commandStream;
-                x = game.animations[i].x;
-                y = game.animations[i].y;
-                complete = false;
 
-                while (complete == false) {
-                    command = *ptr++;
+                switch (command) {
+                    case ANIM_CMD_DELAY16:  //long delay, does not count as a command
+                        game.animations[i].wakeFrame = now + (ptr[0] | (ptr[1] << 8)) + 1;
+                        ptr += 2;
+                        ScheduleAnimation(i);
+                        complete = true;
+                        continue;
 
-                    if (command & 0x80) {
-                        //delay command
-                        game.animations[i].delay = command & 0x7f;
+                    case ANIM_CMD_END:  //end of stream, give back the slot
+                        ptr = NULL;
+                        game.animations[i].next = game.animFree;
+                        game.animFree = i;
                         complete = true;
-                    } else {
-
-                        switch (command) {
-                            case ANIM_CMD_END:  //end of stream
-                                game.animations[i].commandStream = NULL;
-                                return;
-
-                            case ANIM_CMD_SETTILE:  //set tile at (x,y)
-                                SetTile(x, y, *ptr++);
-                                break;
-
-                            case ANIM_CMD_SETSPRITE:    //set sprite tileIndex
-                                if (game.animations[i].commandCount == 0) {
-                                    sprites[game.animations[i].param1].x = x;
-                                    sprites[game.animations[i].param1].y = y;
-                                }
-                                sprites[game.animations[i].param1].tileIndex = *ptr++;
-                                break;
-
-                            case ANIM_CMD_TURNOFFSPRITE:
-                                sprites[game.animations[i].param1].x = SPR_OFF;
-                                break;
-
-                            case ANIM_CMD_SETSPRITEATTR:
-                                sprites[game.animations[i].param1].flags = *ptr++;
-                                break;
-
-                            case ANIM_CMD_FLIP_SPRITE_ATTR:
-                                sprites[game.animations[i].param1].flags ^= *ptr++;
-                                break;
+                        break;
+
+                    case ANIM_CMD_SETTILE:  //set tile at (x,y)
+                        SetFieldTile(x, y, *ptr++);
+                        break;
+
+                    case ANIM_CMD_SETSPRITE:    //set sprite tileIndex
+                        if (game.animations[i].commandCount == 0) {
+                            sprites[game.animations[i].param1].x = x;
+                            sprites[game.animations[i].param1].y = y;
+                        }
+                        sprites[game.animations[i].param1].tileIndex = *ptr++;
+                        break;
+
+                    case ANIM_CMD_TURNOFFSPRITE:
+                        sprites[game.animations[i].param1].x = SPR_OFF;
+                        break;
+
+                    case ANIM_CMD_SETSPRITEATTR:
+                        sprites[game.animations[i].param1].flags = *ptr++;
+                        break;
+
+                    case ANIM_CMD_FLIP_SPRITE_ATTR:
+                        sprites[game.animations[i].param1].flags ^= *ptr++;
+                        break;
+
+                    case ANIM_CMD_LOOP: //repeat the previous ptr[1] bytes ptr[0] times
+                        if (game.animations[i].loopCount == 0) {
+                            game.animations[i].loopCount = ptr[0];
+                        }
+                        ptr += 2;
+                        if (--game.animations[i].loopCount != 0) {
+                            ptr -= ptr[-1];
                         }
-                        game.animations[i].commandCount++;
+                        break;
 
+                    case ANIM_CMD_MOVE: { //move the owner, dx is along its facing direction
+                        s8 owner = game.animations[i].owner;
+                        player.x[owner] += (s8)ptr[0] * player.dir[owner] * 0x100;
+                        player.y[owner] += (s8)ptr[1] * 0x100;
+                        ptr += 2;
+                        sprites[game.animations[i].param1].x = player.x[owner] >> 8;
+                        sprites[game.animations[i].param1].y = player.y[owner] >> 8;
+                        break;
                     }
 
+                    case ANIM_CMD_EVENT:
+                        AnimationEvent(game.animations[i].owner, *ptr++);
+                        break;
                 }
-                game.animations[i].commandStream = ptr;
+                game.animations[i].commandCount++;
+
             }
 
         }
+        game.animations[i].commandStream = ptr;
+    }
+}
+
+//return the hole dug at x,y or HOLE_NONE
+int8_t HoleAt(uint8_t x, uint8_t y) {
+    for (u8 i = 0; i < game.holeCount; i++) {
+        if (game.holes[i].x == x && game.holes[i].y == y)
+            return i;
+    }
+    return HOLE_NONE;
+}
+
+//start digging the brick at x,y, nothing happens when all holes are in use
+void DigHole(uint8_t x, uint8_t y) {
+    if (game.holeCount == MAX_HOLES || HoleAt(x, y) != HOLE_NONE)
+        return;
+
+    Hole *hole = &game.holes[game.holeCount];
+    hole->x = x;
+    hole->y = y;
+    hole->step = 0;
+    hole->occupant = -1;
+    hole->wakeFrame = game.animFrame + HOLE_DIG_DELAY;
+
+    if (game.holeCount == 0 || HOLE_DIG_DELAY < (u16)(game.holeWake - game.animFrame)) {
+        game.holeWake = hole->wakeFrame;
+    }
+    game.holeCount++;
+}
+
+//the enemy climbed out of its hole
+void LeaveHole(uint8_t id) {
+    for (u8 i = 0; i < game.holeCount; i++) {
+        if (game.holes[i].occupant == id) {
+            game.holes[i].occupant = -1;
+        }
     }
 }
 
+//the brick at x,y filled back, whoever has the feet in it is crushed
+void CollapseHole(uint8_t x, uint8_t y) {
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        u8 px = player.x[id] >> 8;
+        u8 py = player.y[id] >> 8;
+
+        if (!player.active[id] || ((px + 4) >> 3) != x || !TILE_HAS(GetTileAtFeet(px, py), TILE_FLAG_DEADLY))
+            continue;
+
+        if (id >= SPR_INDEX_PLAYER) {
+            player.action[id] = ACTION_DIE;
+        } else if (player.action[id] != ACTION_RESPAWN) {
+            player.action[id] = ACTION_RESPAWN;
+            if (player.animSlot[id] != ANIMATION_NONE) {
+                CancelAnimation(player.animSlot[id]);
+                player.animSlot[id] = ANIMATION_NONE;
+            }
+        }
+    }
+}
+
+//invoked once per frame before the clock advances, the holes are only walked
+//on the frames one of them has a step due
+void ProcessHoles() {
+    u16 now = game.animFrame;
+    u16 soonest = 0xffff;
+    u8 i = 0;
+
+    if (game.holeCount == 0 || game.holeWake != now)
+        return;
+
+    while (i < game.holeCount) {
+        Hole *hole = &game.holes[i];
+
+        if (hole->wakeFrame == now) {
+            SetFieldTile(hole->x, hole->y, holeTiles[hole->step]);
+
+            if (hole->step == HOLE_STEPS - 1) {
+                CollapseHole(hole->x, hole->y);
+                //the last hole takes the free entry and is visited next
+                *hole = game.holes[--game.holeCount];
+                continue;
+            }
+            hole->wakeFrame += holeDelays[hole->step++];
+        }
+
+        if ((u16)(hole->wakeFrame - now) < soonest) {
+            soonest = hole->wakeFrame - now;
+        }
+        i++;
+    }
+    game.holeWake = now + soonest;
+}
+
 #define USER_RAMTILES   T17
 
 const u8 titleSpr[] = {0,0, 1,0, 2,0, 5,0, 6,0, 7,0, 10,0, 11,0, 12,0, 13,0,
@@ -219,18 +487,21 @@ const u8 titleSpr[] = {0,0, 1,0, 2,0, 5,0, 6,0, 7,0, 10,0, 11,0, 12,0, 13,0,
     0,2, 9,2, 23,2,
     7,5, 17,5};
 
-const u8 miniMapColors[] = {
-    0x00, 0xE0, 0xE0, 0xFC, 0xFC, 0xE0, 0x00, 0xF0, 0x00, 0x00, //completed colors
-    0x00, 0x54, 0x54, 0xFC, 0xFC, 0x54, 0x00, 0xFC, 0x00, 0x00
+const u8 miniMapColors[2 * LEVEL_CODES] = {
+    0x00, 0xE0, 0xE0, 0xFC, 0xFC, 0xE0, 0x00, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //completed colors
+    0x00, 0x54, 0x54, 0xFC, 0xFC, 0x54, 0x00, 0xFC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
-uint8_t userRamTiles[8 * TILE_WIDTH * TILE_HEIGHT];
+GAME_STATE uint8_t userRamTiles[8 * TILE_WIDTH * TILE_HEIGHT];
 
 void blitLevelPreview(int level) {
 
-    u16 pos = 0, i;
-    u8 x, y, col, tile = 0, offset;
+    u16 i;
+    u8 x, y, col, offset, cells[LEVEL_ROW_CELLS];
+    const u8 *row = cells;
 
+    PROFILE_BEGIN(PROFILE_BLIT_LEVEL_PREVIEW);
+    game.snapshotLevel = LEVEL_NONE;
     ext_data_read(HIGH_EEPROM_OFFSET(&levels[level * LEVEL_SIZE]), game.map, LEVEL_SIZE);
     //u8* userRamTiles = GetUserRamTile(1);
 
@@ -240,7 +511,7 @@ void blitLevelPreview(int level) {
     if (saveGame.playedLevels[level / 8] & (1 << (level % 8))) {
         offset = 0;
     } else {
-        offset = 10;
+        offset = LEVEL_CODES;
     }
 
     if (saveGame.completedLevels[level / 8] & (1 << (level % 8))) {
@@ -250,17 +521,13 @@ void blitLevelPreview(int level) {
     }
 
     for (y = 0; y < 24; y++) {
+        if (y >= 4 && y < 20) {
+            row = DecodeMapRow(y - 4, &miniMapColors[offset], cells);
+        }
         for (x = 0; x < 32; x++) {
             //blit pixel in appropriate ramtile
             if (y >= 4 && y < 20 && x >= 2 && x < 30) {
-                if ((x & 1) == 0) {
-                    tile = game.map[pos];
-                    col = tile >> 4;
-                } else {
-                    col = tile & 0xf;
-                    pos++;
-                }
-                col = miniMapColors[col + offset];
+                col = row[x - 2];
             } else if (y == 0 || x == 0) {
                 col = offset == 0 ? 0x26 : 0xf6;
             } else if (y == 23 || x == 31) {
@@ -268,23 +535,36 @@ void blitLevelPreview(int level) {
             } else {
                 col = offset == 0 ? 0x01 : 0x0; //pgm_read_byte(&miniMapColors[0+offset]);
             }
-            i = ((x / 8) * TILE_WIDTH * TILE_HEIGHT) + (x % 8) + ((y / 12) * (TILE_WIDTH * TILE_HEIGHT * 4)) + ((y % 12) * TILE_WIDTH);
+            i = ((x / 8) * TILE_WIDTH * TILE_HEIGHT) + (x % 8) + (TILE_ROW(y) * (TILE_WIDTH * TILE_HEIGHT * 4)) + ((y - TILE_ROW(y) * TILE_HEIGHT) * TILE_WIDTH);
             userRamTiles[i] = col;
         }
     }
 
     int32_t offs = (GPU_TILES_RAM + (USER_RAMTILES * TILE_WIDTH * TILE_HEIGHT)) - GPU_MAILBOX;
     hs_tx(sizeof(userRamTiles) / sizeof(uint32_t), userRamTiles, 0, (offs & 0xFFFF) >> 2);
+    PROFILE_END(PROFILE_BLIT_LEVEL_PREVIEW);
 }
 
-void GameTitle() {
-    u8 tx = 3, ty = 6, i, j, x, y;
+//title screen and level selector, starts the level task
+uint8_t TitleTask() {
+    u8 i, j, x, y;
     const u8 *pos = titleSpr;
-
-    //FadeIn(0, true);
+    u16 key;
+    bool doFx = false;
 
     //SetUserRamTilesCount(1);
-    u8 bgRamtileNo = 0; //RAM_TILES_COUNT-1;
+    const u8 bgRamtileNo = 0; //RAM_TILES_COUNT-1;
+
+    TASK_BEGIN(TASK_TITLE);
+
+    game.displayCredits = false;
+
+    player.lives[SPR_INDEX_PLAYER] = 6;
+
+    hideAllSprites();
+    ClearVram();
+
+    //FadeIn(0, true);
 
     //title screen
 //  CopyRamTileToRam(13+RAM_TILES_COUNT,bgRamtileNo);//USER_RAM_TILES);
@@ -295,19 +575,21 @@ void GameTitle() {
     Fill(0, 7, SCREEN_TILES_H, 1, 3);
     Fill(0, 8, SCREEN_TILES_H, 1, 3);
 
-    WaitVsync(10);
+    TASK_SLEEP(10);
 
-    DrawMap2(tx + 1, ty + 1, title1);
-    DrawMap2(tx + 10, ty + 1, title2);
-    DrawMap2(tx + 23, ty + 1, title3);
+    screenState.tx = 3;
+    screenState.ty = 6;
+    DrawMap2(screenState.tx + 1, screenState.ty + 1, title1);
+    DrawMap2(screenState.tx + 10, screenState.ty + 1, title2);
+    DrawMap2(screenState.tx + 23, screenState.ty + 1, title3);
 
     TriggerFx(10, 0x80, false);
 
     for (i = 0; i < 18; i++) {
         x = *pos++;
         y = *pos++;
-        sprites[i].x = (x + tx) * 8;
-        sprites[i].y = (y + ty) * 12;
+        sprites[i].x = (x + screenState.tx) * 8;
+        sprites[i].y = (y + screenState.ty) * 12;
         sprites[i].tileIndex = i;
         sprites[i].flags = 0;
     }
@@ -319,57 +601,57 @@ void GameTitle() {
 
 //  FadeIn(3,false);
 
-    u8 anim = 0;
+    screenState.anim = 0;
 
     while (1) {
-        WaitVsync(2);
+        TASK_SLEEP(2);
 
         //scrollBg();
 
-        if (anim < 7) {
+        if (screenState.anim < 7) {
 
-            if (anim > 0) {
-                Fill(0, 7 - anim, SCREEN_TILES_H, 1, bgRamtileNo);
-                Fill(0, 8 + anim, SCREEN_TILES_H, 1, bgRamtileNo);
+            if (screenState.anim > 0) {
+                Fill(0, 7 - screenState.anim, SCREEN_TILES_H, 1, bgRamtileNo);
+                Fill(0, 8 + screenState.anim, SCREEN_TILES_H, 1, bgRamtileNo);
             }
-            if (anim == 0) {
+            if (screenState.anim == 0) {
                 Fill(0, 7, 4, 2, bgRamtileNo);
                 Fill(26, 7, 6, 2, bgRamtileNo);
                 Fill(12, 7, 1, 2, bgRamtileNo);
-                DrawMap2(tx + 23, ty + 1, title3);
-            } else if (anim == 3) {
-                DrawMap2(tx + 8, ty + 5, title4);
-                sprites[16].x = (tx + 7) * TILE_WIDTH;
-                sprites[17].x = (tx + 17) * TILE_WIDTH;
+                DrawMap2(screenState.tx + 23, screenState.ty + 1, title3);
+            } else if (screenState.anim == 3) {
+                DrawMap2(screenState.tx + 8, screenState.ty + 5, title4);
+                sprites[16].x = (screenState.tx + 7) * TILE_WIDTH;
+                sprites[17].x = (screenState.tx + 17) * TILE_WIDTH;
             }
 
-            anim++;
+            screenState.anim++;
 
-            Fill(0, 7 - anim, SCREEN_TILES_H, 1, 3);
-            Fill(0, 8 + anim, SCREEN_TILES_H, 1, 3);
+            Fill(0, 7 - screenState.anim, SCREEN_TILES_H, 1, 3);
+            Fill(0, 8 + screenState.anim, SCREEN_TILES_H, 1, 3);
         }
 
-        while (ReadJoypad(0) == BTN_SELECT)
-            ;
-        if (ReadJoypad(0) == BTN_START)
+        //holding select freezes the title
+        TASK_WAIT_UNTIL(InputState() != BTN_SELECT);
+        if (ReadInputPresses() & BTN_START)
             break;
     }
 
     TriggerFx(11, 0x80, false);
 
-    for (i = 0; i < 7; i++) {
-        WaitVsync(2);
+    for (screenState.step = 0; screenState.step < 7; screenState.step++) {
+        TASK_SLEEP(2);
         //scrollBg();
-        anim--;
-        Fill(0, 7 - anim, SCREEN_TILES_H, 1, 3);
-        Fill(0, 8 + anim, SCREEN_TILES_H, 1, 3);
-        Fill(0, 7 - anim - 1, SCREEN_TILES_H, 1, 0);
-        Fill(0, 8 + anim + 1, SCREEN_TILES_H, 1, 0);
+        screenState.anim--;
+        Fill(0, 7 - screenState.anim, SCREEN_TILES_H, 1, 3);
+        Fill(0, 8 + screenState.anim, SCREEN_TILES_H, 1, 3);
+        Fill(0, 7 - screenState.anim - 1, SCREEN_TILES_H, 1, 0);
+        Fill(0, 8 + screenState.anim + 1, SCREEN_TILES_H, 1, 0);
 
-        if (anim == 3) {
+        if (screenState.anim == 3) {
             sprites[16].x = SCREEN_TILES_H * TILE_WIDTH;
             sprites[17].x = SCREEN_TILES_H * TILE_WIDTH;
-        } else if (anim == 1) {
+        } else if (screenState.anim == 1) {
             sprites[9].x = SCREEN_TILES_H * TILE_WIDTH;
         }
     }
@@ -378,28 +660,28 @@ void GameTitle() {
         sprites[j].x = SCREEN_TILES_H * TILE_WIDTH;
     }
 
-    WaitVsync(8);
+    TASK_SLEEP(8);
 
     TriggerFx(10, 0x80, false);
 
-    anim = 0;
-    while (anim < 7) {
-        WaitVsync(2);
+    screenState.anim = 0;
+    while (screenState.anim < 7) {
+        TASK_SLEEP(2);
         //scrollBg();
 
-        Fill(0, 7 - anim, SCREEN_TILES_H, 1, bgRamtileNo);
-        Fill(0, 8 + anim, SCREEN_TILES_H, 1, bgRamtileNo);
-        anim++;
+        Fill(0, 7 - screenState.anim, SCREEN_TILES_H, 1, bgRamtileNo);
+        Fill(0, 8 + screenState.anim, SCREEN_TILES_H, 1, bgRamtileNo);
+        screenState.anim++;
 
-        Fill(0, 7 - anim, SCREEN_TILES_H, 1, 3);
-        Fill(0, 8 + anim, SCREEN_TILES_H, 1, 3);
+        Fill(0, 7 - screenState.anim, SCREEN_TILES_H, 1, 3);
+        Fill(0, 8 + screenState.anim, SCREEN_TILES_H, 1, 3);
 
-        tx = 11;
-        ty = 8;
-        if (anim == 1) {
+        screenState.tx = 11;
+        screenState.ty = 8;
+        if (screenState.anim == 1) {
             for (i = 0; i < 8; i++) {
-                sprites[i].x = (i + tx) * 8;
-                sprites[i].y = ty * 12;
+                sprites[i].x = (i + screenState.tx) * 8;
+                sprites[i].y = screenState.ty * 12;
             }
             sprites[0].tileIndex = 19; //30;
             sprites[1].tileIndex = 20; //31;
@@ -415,34 +697,23 @@ void GameTitle() {
 
     //SetUserRamTilesCount(9);
     blitLevelPreview(game.level);
-    vram[(SCREEN_TILES_H * 5) + tx + 2] = USER_RAMTILES; // 1; //RAM_TILES_COUNT-9;
-    vram[(SCREEN_TILES_H * 5) + tx + 3] = USER_RAMTILES + 1; // 2; //RAM_TILES_COUNT-8;
-    vram[(SCREEN_TILES_H * 5) + tx + 4] = USER_RAMTILES + 2; // 3; //RAM_TILES_COUNT-7;
-    vram[(SCREEN_TILES_H * 5) + tx + 5] = USER_RAMTILES + 3; // 4; //RAM_TILES_COUNT-6;
-    vram[(SCREEN_TILES_H * 6) + tx + 2] = USER_RAMTILES + 4; // 5; //RAM_TILES_COUNT-5;
-    vram[(SCREEN_TILES_H * 6) + tx + 3] = USER_RAMTILES + 5; // 6; //RAM_TILES_COUNT-4;
-    vram[(SCREEN_TILES_H * 6) + tx + 4] = USER_RAMTILES + 6; // 7; //RAM_TILES_COUNT-3;
-    vram[(SCREEN_TILES_H * 6) + tx + 5] = USER_RAMTILES + 7; // 8; //RAM_TILES_COUNT-2;
-
-    u16 lastKey = 0, key = 0, repeatDelay = 0, hold = 0, speed;
-    bool doFx = false;
+    vram[(SCREEN_TILES_H * 5) + screenState.tx + 2] = USER_RAMTILES; // 1; //RAM_TILES_COUNT-9;
+    vram[(SCREEN_TILES_H * 5) + screenState.tx + 3] = USER_RAMTILES + 1; // 2; //RAM_TILES_COUNT-8;
+    vram[(SCREEN_TILES_H * 5) + screenState.tx + 4] = USER_RAMTILES + 2; // 3; //RAM_TILES_COUNT-7;
+    vram[(SCREEN_TILES_H * 5) + screenState.tx + 5] = USER_RAMTILES + 3; // 4; //RAM_TILES_COUNT-6;
+    vram[(SCREEN_TILES_H * 6) + screenState.tx + 2] = USER_RAMTILES + 4; // 5; //RAM_TILES_COUNT-5;
+    vram[(SCREEN_TILES_H * 6) + screenState.tx + 3] = USER_RAMTILES + 5; // 6; //RAM_TILES_COUNT-4;
+    vram[(SCREEN_TILES_H * 6) + screenState.tx + 4] = USER_RAMTILES + 6; // 7; //RAM_TILES_COUNT-3;
+    vram[(SCREEN_TILES_H * 6) + screenState.tx + 5] = USER_RAMTILES + 7; // 8; //RAM_TILES_COUNT-2;
+
     while (1) {
-        WaitVsync(2);
+        TASK_SLEEP(2);
         //scrollBg();
 
-        key = ReadJoypad(0);
-        if (key == 0) {
-            repeatDelay = 0;
-            hold = 0;
-        }
-        if (hold > 4) {
-            speed = 2;
-        } else {
-            speed = 5;
-        }
-        if (key == lastKey && key != 0)
-            repeatDelay++;
-        if (key != lastKey || repeatDelay >= speed) {
+        //held directions repeat, faster after a few steps
+        key = GetInputEvent();
+        if ((key & INPUT_KIND) == INPUT_PRESS || (key & INPUT_KIND) == INPUT_REPEAT) {
+            key &= INPUT_BUTTONS;
             if (key == BTN_START) {
                 break;
             } else if (key == BTN_RIGHT) {
@@ -465,9 +736,6 @@ void GameTitle() {
                 TriggerFx(13, SFX_VOLUME, true);
 
             doFx = false;
-            lastKey = key;
-            repeatDelay = 0;
-            hold++;
         }
     }
 
@@ -476,16 +744,16 @@ void GameTitle() {
     //FadeOut(3, false);
     sprites[10].x = SCREEN_TILES_H * TILE_WIDTH;
 
-    for (i = 0; i < 7; i++) {
-        WaitVsync(2);
+    for (screenState.step = 0; screenState.step < 7; screenState.step++) {
+        TASK_SLEEP(2);
         //scrollBg();
-        anim--;
-        Fill(0, 7 - anim, SCREEN_TILES_H, 1, 3);
-        Fill(0, 8 + anim, SCREEN_TILES_H, 1, 3);
-        Fill(0, 7 - anim - 1, SCREEN_TILES_H, 1, 0);
-        Fill(0, 8 + anim + 1, SCREEN_TILES_H, 1, 0);
+        screenState.anim--;
+        Fill(0, 7 - screenState.anim, SCREEN_TILES_H, 1, 3);
+        Fill(0, 8 + screenState.anim, SCREEN_TILES_H, 1, 3);
+        Fill(0, 7 - screenState.anim - 1, SCREEN_TILES_H, 1, 0);
+        Fill(0, 8 + screenState.anim + 1, SCREEN_TILES_H, 1, 0);
 
-        if (anim == 1) {
+        if (screenState.anim == 1) {
 
             for (j = 0; j < 9; j++) {
                 sprites[j].x = SCREEN_TILES_H * TILE_WIDTH;
@@ -493,11 +761,15 @@ void GameTitle() {
         }
     }
 
-    WaitVsync(30);
-    while (ReadJoypad(0) != 0)
-        ;
+    TASK_SLEEP(30);
+    TASK_WAIT_UNTIL(InputState() == 0);
+    FlushInput();
 
     ClearVram();
+    hideAllSprites();
+
+    StartScreen(TASK_LEVEL);
+    TASK_END();
 }
 
 //Print an unsigned byte in decimal -- 2 gigits max
@@ -516,16 +788,43 @@ void PrintByte2(int x, int y, unsigned char val) {
 
 }
 
+//splits row y of the level in game.map into one byte per column mapped
+//through lut, which has LEVEL_CODES entries. The row is read 32 bits at a
+//time and the nibbles of each word are separated with two masks, cells holds
+//LEVEL_ROW_CELLS bytes and the first column of the row is returned.
+const uint8_t *DecodeMapRow(uint8_t y, const uint8_t *lut, uint8_t *cells) {
+    const u32 *word = &game.mapWords[(y * LEVEL_ROW_BYTES) >> 2];
+    u32 hi, lo;
+
+    for (u8 i = 0; i < LEVEL_ROW_CELLS; i += 8) {
+        //the first byte is the low one of the word, its high nibble comes first
+        lo = *word++;
+        hi = (lo >> 4) & 0x0f0f0f0f;
+        lo &= 0x0f0f0f0f;
+        cells[i] = lut[hi & 0x0f];
+        cells[i + 1] = lut[lo & 0x0f];
+        cells[i + 2] = lut[(hi >> 8) & 0x0f];
+        cells[i + 3] = lut[(lo >> 8) & 0x0f];
+        cells[i + 4] = lut[(hi >> 16) & 0x0f];
+        cells[i + 5] = lut[(lo >> 16) & 0x0f];
+        cells[i + 6] = lut[hi >> 24];
+        cells[i + 7] = lut[lo >> 24];
+    }
+
+    //odd rows start in the middle of a word
+    return cells + ((y & 1) << 2);
+}
+
 void UnpackGameMap(uint8_t mapNo) {
-    u16 pos = 0;
-    u8 x, y, nibble, tile, enemyCount = 0, id = 0;
+    u8 x, y, tile, enemyCount = 0, id = 0, cells[LEVEL_ROW_CELLS];
+    const u8 *row;
 
+    game.snapshotLevel = LEVEL_NONE;
     ext_data_read(HIGH_EEPROM_OFFSET(&levels[mapNo * LEVEL_SIZE]), game.map, LEVEL_SIZE);
 
     game.goldCount = 0;
     for (u8 id = 0; id < MAX_PLAYERS; id++) {
-        player[id].active = false;
-        sprites[id * 2].x = SPR_OFF;
+        game.spawnX[id] = 0;
     }
 
     //fill background
@@ -537,109 +836,161 @@ void UnpackGameMap(uint8_t mapNo) {
         SetTile(VRAM_TILES_H - 1, y, TILE_BREAKABLE);
     }
 
-    for (y = 0; y < 16; y++) {
-        for (x = 0; x < 28; x += 2) {
-            for (nibble = 0; nibble < 2; nibble++) {
-                if (nibble == 0) {
-                    tile = game.map[pos] >> 4;
+    for (y = 0; y < FIELD_HEIGHT; y++) {
+        row = DecodeMapRow(y, levelTiles, cells);
+        for (x = 0; x < FIELD_WIDTH; x++) {
+            tile = row[x];
+
+            if (tile == TILE_GOLD1) {
+                if (game.goldCount < MAX_GOLD) {
+                    game.gold[game.goldCount].x = x + 1;
+                    game.gold[game.goldCount].y = y;
+                    game.gold[game.goldCount].state = GOLD_STATE_VISIBLE;
+                    game.goldCount++;
                 } else {
-                    tile = game.map[pos] & 0x0f;
+                    tile = 0;
                 }
 
-                switch (tile) {
-                    case 1:
-                        tile = TILE_BREAKABLE;
-                        break;
-                    case 2:
-                        tile = TILE_UNBREAKABLE;
-                        break;
-                    case 3:
-                        tile = TILE_LADDER;
-                        break;
-                    case 4:
-                        tile = TILE_ROPE;
-                        break;
-                    case 5:
-                        tile = TILE_BREAKABLE_FAKE;
-                        break;
-                    case 6:
-                        //escape ladder
-                        tile = TILE_BG;
-                        break;
-                    case 7:
-                        if (game.goldCount < MAX_GOLD) {
-                            tile = TILE_GOLD1;
-                            game.gold[game.goldCount].x = x + nibble + 1;
-                            game.gold[game.goldCount].y = y;
-                            game.gold[game.goldCount].state = GOLD_STATE_VISIBLE;
-                            game.goldCount++;
-                        } else {
-                            tile = 0;
-                        }
-                        break;
-                    case 8:
-                        //enemy
-                        //tile=0;
-                        //break;
-                    case 9:
-                        //player
-
-                        id = (tile == 8 ? enemyCount : SPR_INDEX_PLAYER);
-
-                        player[id].active = true;
-                        player[id].x = (u16)(((x + nibble + 1) * TILE_WIDTH) << 8);
-                        player[id].y = (u16)((y * TILE_HEIGHT) << 8);
-                        player[id].dir = (id < SPR_INDEX_PLAYER ? -1 : 1);
-                        player[id].frame = 0;
-
-                        if (tile == 9) {
-                            //player
-                            player[id].playerSpeed = 0x0C0;
-                            player[id].frameSpeed = 0x04;
-                        } else {
-                            //enemies
-
-                            player[id].playerSpeed = 0x060;
-                            player[id].frameSpeed = 0x04;
-
-                            player[id].respawnX = (6 * 8);
-                            player[id].aiTarget = 0;
-                            player[id].lastAiAction = 0;
-                            player[id].capturedGoldId = -1;
-                            player[id].lastCapturedGoldId = -1;
-                            player[id].capturedGoldDelay = 0;
-                            player[id].stuckDelay = 0;
-                        }
+            } else if (tile == LEVEL_SPAWN_ENEMY || tile == LEVEL_SPAWN_PLAYER) {
+                //the last slot is the player's (level 8 has one enemy too many)
+                if (tile == LEVEL_SPAWN_PLAYER || enemyCount < SPR_INDEX_PLAYER) {
+                    id = (tile == LEVEL_SPAWN_ENEMY ? enemyCount++ : SPR_INDEX_PLAYER);
 
-                        player[id].action = ACTION_WALK;
-                        player[id].died = false;
-                        player[id].spriteIndex = id * 2;
-                        Walk(id, player[id].dir);
+                    //spawned once the whole field is drawn
+                    game.spawnX[id] = x + 1;
+                    game.spawnY[id] = y;
+                }
+                tile = 0;
 
-                        if (tile == 8)
-                            enemyCount++;
-                        tile = 0;
-                        break;
+            } else if (tile == LEVEL_EXIT_LADDER) {
+                //background until all gold is collected
+                tile = TILE_BG;
+            }
 
-                    default:
-                        tile = 0;
+            if (tile != 0) {
+                SetTile(x + 1, y, tile);
+                if (y < 15 && (tile == TILE_BREAKABLE || tile == TILE_UNBREAKABLE || tile == TILE_BREAKABLE_FAKE || tile == TILE_LADDER)) {
+                    SetTile(x + 1, y + 1, TILE_SHADOW);
                 }
+            }
+        }
+    }
+
+    game.level = mapNo;
+    TakeLevelSnapshot();
+    StartLevel();
+}
+
+//puts player id on its start tile, the field must be drawn
+void SpawnPlayer(uint8_t id) {
+    if (id >= MAX_PLAYERS)
+        return;
+
+    player.active[id] = true;
+    player.x[id] = (u16)((game.spawnX[id] * TILE_WIDTH) << 8);
+    player.y[id] = (u16)((game.spawnY[id] * TILE_HEIGHT) << 8);
+    player.dir[id] = (id < SPR_INDEX_PLAYER ? -1 : 1);
+    player.frame[id] = 0;
+
+    if (id == SPR_INDEX_PLAYER) {
+        player.playerSpeed[id] = 0x0C0;
+        player.frameSpeed[id] = 0x04;
+    } else {
+        player.playerSpeed[id] = 0x060;
+        player.frameSpeed[id] = 0x04;
+
+        player.respawnX[id] = (6 * 8);
+        player.capturedGoldId[id] = -1;
+        player.lastCapturedGoldId[id] = -1;
+        player.capturedGoldDelay[id] = 0;
+    }
+
+    player.action[id] = ACTION_WALK;
+    player.lastAction[id] = ACTION_NONE;
+    player.animSlot[id] = ANIMATION_NONE;
+    player.cellX[id] = TILE_CELL_NONE;
+    player.died[id] = false;
+    player.spriteIndex[id] = id * 2;
+    player.spriteBase[id] = (id < SPR_INDEX_PLAYER ? SPR_ENEMY_OFFSET : 0);
+    Walk(id, player.dir[id]);
+}
 
-                if (tile != 0) {
-                    SetTile(x + nibble + 1, y, tile);
-                    if (y < 15 && (tile == TILE_BREAKABLE || tile == TILE_UNBREAKABLE || tile == TILE_BREAKABLE_FAKE || tile == TILE_LADDER)) {
-                        SetTile(x + nibble + 1, y + 1, TILE_SHADOW);
+//turns the level read in game.map into the SNAPSHOT_* cells of the field just
+//unpacked, in place: each byte only depends on the same byte of the level
+void TakeLevelSnapshot() {
+    u16 pos = 0;
+    u8 x, y, nibble, tile, cell, packed, cells[LEVEL_ROW_CELLS];
+    const u8 *row;
+
+    for (y = 0; y < FIELD_HEIGHT; y++) {
+        //decoded before the row is written over, the next row only shares
+        //a word with it and skips its cells
+        row = DecodeMapRow(y, levelTiles, cells);
+        for (x = 0; x < FIELD_WIDTH; x += 2) {
+            packed = 0;
+            for (nibble = 0; nibble < 2; nibble++) {
+                if (row[x + nibble] == LEVEL_EXIT_LADDER) {
+                    cell = SNAPSHOT_EXIT_LADDER;
+                } else {
+                    tile = vram[vramRowOffset[y] + x + nibble + 1];
+                    for (cell = 0; cell < SNAPSHOT_EXIT_LADDER && snapshotTiles[cell] != tile; cell++)
+                        ;
+                    if (cell == SNAPSHOT_EXIT_LADDER) {
+                        cell = SNAPSHOT_BG;
                     }
                 }
+                packed = (packed << 4) | cell;
+            }
+            game.map[pos++] = packed;
+        }
+    }
+
+    game.snapshotLevel = game.level;
+}
+
+//starts the level again from its snapshot, without reading and decoding it
+void RestartLevel() {
+    u8 x, y, cells[LEVEL_ROW_CELLS];
+    const u8 *tiles;
+    u8 *row;
+
+    game.goldCount = 0;
+    for (y = 0; y < FIELD_HEIGHT; y++) {
+        tiles = DecodeMapRow(y, snapshotTiles, cells);
+        row = &vram[vramRowOffset[y]];
+        row[0] = TILE_BREAKABLE;
+        row[VRAM_TILES_H - 1] = TILE_BREAKABLE;
+        for (x = 1; x <= FIELD_WIDTH; x++) {
+            row[x] = tiles[x - 1];
+
+            //same order as UnpackGameMap, gold ids are the same
+            if (row[x] == TILE_GOLD1) {
+                game.gold[game.goldCount].x = x;
+                game.gold[game.goldCount].y = y;
+                game.gold[game.goldCount].state = GOLD_STATE_VISIBLE;
+                game.goldCount++;
             }
-            pos++;
+        }
+    }
+
+    StartLevel();
+}
+
+//common to UnpackGameMap and RestartLevel, once the field is drawn
+void StartLevel() {
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        player.active[id] = false;
+        sprites[id * 2].x = SPR_OFF;
+    }
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        if (game.spawnX[id] != 0) {
+            SpawnPlayer(id);
         }
     }
 
     game.goldAnimFrame = 0;
     game.goldCollected = 0;
     game.goldAnimSpeed = 1;
-    game.level = mapNo;
     game.totalLevels = LEVELS_COUNT;
     game.levelComplete = false;
     game.levelRestart = false;
@@ -655,7 +1006,7 @@ void UnpackGameMap(uint8_t mapNo) {
     PrintByte2(11, 16, game.level + 1);
 
     UpdateInfo();
-
+    InitAi();
 }
 
 void UpdateInfo() {
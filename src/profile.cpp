@@ -0,0 +1,157 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//hot path profiler, add -DPROFILE to the CFLAGS of the project to build it.
+//PROFILE_BEGIN/PROFILE_END put a CNT stamped record in the ring of the cog
+//running the zone and a cog of its own sends the rings out of PROFILE_TX_PIN
+//(the programming port) at PROFILE_BAUD, 8N1. It also reports how deep the
+//cog stacks have been used, they are filled with PROFILE_STACK_FILL before
+//the cogs start. tools/profview.cpp reads the capture. The rings and the
+//stack take about 850 bytes of hub, without PROFILE the macros are empty.
+#ifdef PROFILE
+
+#include <propeller.h>
+
+u32 profileStack[PROFILE_STACK_LONGS];
+
+void StartProfileCog() {
+    PROFILE_FILL_STACK(profileStack);
+    cogstart(ProfileCog, NULL, profileStack, sizeof(profileStack));
+}
+
+//cog profiled side, the ring is chosen by the zone so each has a single writer
+void ProfileRecord(uint8_t event) {
+    ProfileRing *ring = &profile[(event >> 4) & 1];
+    u8 head = ring->head;
+
+    if (((head + 1) & (PROFILE_RING_SIZE - 1)) == ring->tail) {
+        ring->dropped++;
+        return;
+    }
+    ring->records[head] = (CNT << 8) | event;
+    ring->head = (head + 1) & (PROFILE_RING_SIZE - 1);
+}
+
+void ProfileFillStack(uint32_t *stack, uint16_t longs) {
+    for (u16 i = 0; i < longs; i++) {
+        stack[i] = PROFILE_STACK_FILL;
+    }
+}
+
+//profiler cog side
+
+//longs of a cog stack still holding the fill, 0xffff for a cog not started
+uint16_t ProfileStackLeft(uint8_t s) {
+    const u32 *stack;
+    u16 longs, left = 0;
+
+    switch (s) {
+#ifndef AI_SAME_COG
+        case PROFILE_STACK_AI:
+            stack = aiStack;
+            longs = AI_STACK_LONGS;
+            break;
+#endif
+#ifndef INPUT_SAME_COG
+        case PROFILE_STACK_INPUT:
+            stack = inputStack;
+            longs = INPUT_STACK_LONGS;
+            break;
+#endif
+        case PROFILE_STACK_PROFILER:
+            stack = profileStack;
+            longs = PROFILE_STACK_LONGS;
+            break;
+        default:
+            return 0xffff;
+    }
+
+    //the stack grows down towards the thread state at the bottom
+    for (u16 i = 0; i < longs; i++) {
+        if (stack[i] == PROFILE_STACK_FILL)
+            left++;
+    }
+    return left;
+}
+
+void ProfileCog(void *par) {
+    u32 bitCycles = CLKFREQ / PROFILE_BAUD;
+    u16 sent[2] = { 0, 0 };     //dropped records already reported
+    u16 low[PROFILE_STACKS] = { 0xffff, 0xffff, 0xffff };  //stack marks already reported
+    u8 records = 0;
+
+    OUTA |= 1 << PROFILE_TX_PIN;
+    DIRA |= 1 << PROFILE_TX_PIN;
+
+    while (1) {
+        for (u8 r = 0; r < 2; r++) {
+            ProfileRing *ring = &profile[r];
+            u16 dropped = ring->dropped;
+
+            if (dropped != sent[r]) {
+                ProfileSend(((u32) (u16) (dropped - sent[r]) << 8) | PROFILE_DROPPED | r, bitCycles);
+                sent[r] = dropped;
+            }
+            if (ring->tail != ring->head) {
+                ProfileSend(ring->records[ring->tail], bitCycles);
+                ring->tail = (ring->tail + 1) & (PROFILE_RING_SIZE - 1);
+
+                //lets the viewer find the record boundaries in the stream
+                if (++records == PROFILE_SYNC_RECORDS) {
+                    ProfileSend(0xffffffff, bitCycles);
+                    records = 0;
+
+                    for (u8 s = 0; s < PROFILE_STACKS; s++) {
+                        u16 left = ProfileStackLeft(s);
+                        if (left < low[s]) {
+                            ProfileSend(((u32) left << 8) | PROFILE_STACK | s, bitCycles);
+                            low[s] = left;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//4 bytes, least significant first
+void ProfileSend(uint32_t record, uint32_t bitCycles) {
+    for (u8 i = 0; i < 4; i++) {
+        ProfileTx(record & 0xff, bitCycles);
+        record >>= 8;
+    }
+}
+
+void ProfileTx(uint8_t value, uint32_t bitCycles) {
+    u32 bits = (value | 0x100) << 1;    //start bit, 8 data bits, stop bit
+    u32 next = CNT;
+
+    for (u8 i = 0; i < 10; i++) {
+        if (bits & 1) {
+            OUTA |= 1 << PROFILE_TX_PIN;
+        } else {
+            OUTA &= ~(1 << PROFILE_TX_PIN);
+        }
+        bits >>= 1;
+        next += bitCycles;
+        waitcnt(next);
+    }
+}
+
+#endif
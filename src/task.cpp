@@ -0,0 +1,95 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+//cooperative scheduler, run by main() once per vsync: the screen in front
+//(title, level, pause, game over) gets the frame first, each background task
+//then runs if the screen only waited in this frame. A task returns at each
+//wait and resumes there on a later frame, see TASK_BEGIN.
+
+#include <propeller.h>
+
+uint8_t (* const taskFunctions[TASK_COUNT])() = {
+    TitleTask, LevelTask, PauseTask, GameOverTask, SaveTask
+};
+
+void StartTasks() {
+    scheduler.vsyncCnt = CNT;
+    StartScreen(TASK_TITLE);
+}
+
+//vsyncs since the last call, timed on CNT: WaitVsync(1) returns on the next
+//vsync, the one after when the frame overran
+uint8_t CountVsyncs() {
+    u32 now = CNT;
+    u32 period = CLKFREQ / FRAME_HZ;
+    u32 elapsed = now - scheduler.vsyncCnt + period / 2;
+    u8 vsyncs = 0;
+
+    scheduler.vsyncCnt = now;
+    while (elapsed >= period && vsyncs < 0xff) {
+        elapsed -= period;
+        vsyncs++;
+    }
+    return vsyncs > 0 ? vsyncs : 1;
+}
+
+//puts screen id in front, from its top
+void StartScreen(uint8_t id) {
+    scheduler.screen = id;
+    scheduler.caller = TASK_NONE;
+    scheduler.tasks[id].line = 0;
+    scheduler.tasks[id].wake = scheduler.frame;
+}
+
+//runs screen id over the one in front, which resumes when id is done
+void CallScreen(uint8_t id) {
+    u8 caller = scheduler.screen;
+
+    StartScreen(id);
+    scheduler.caller = caller;
+}
+
+uint8_t RunTask(uint8_t id) {
+    //wake is at most 0x7fff frames ahead
+    if ((s16)(scheduler.frame - scheduler.tasks[id].wake) < 0)
+        return TASK_WAITING;
+    return taskFunctions[id]();
+}
+
+void RunTasks() {
+    u8 screen = scheduler.screen;
+    u8 state;
+    u8 vsyncs = CountVsyncs();
+
+    scheduler.frame += vsyncs;
+    scheduler.ticks = vsyncs > FRAME_CATCH_UP ? FRAME_CATCH_UP + 1 : vsyncs;
+
+    state = RunTask(screen);
+    if (state == TASK_DONE && scheduler.screen == screen && scheduler.caller != TASK_NONE) {
+        scheduler.screen = scheduler.caller;
+        scheduler.caller = TASK_NONE;
+    }
+    if (state == TASK_BUSY)
+        return;
+
+    for (u8 id = TASK_BACKGROUND; id < TASK_COUNT; id++) {
+        RunTask(id);
+    }
+}
@@ -0,0 +1,379 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Host side animation assembler.
+ *
+ *  Validates the animation scripts and emits the ANIM_CMD_* byte tables
+ *  interpreted by ProcessAnimations.
+ *
+ *      g++ -O2 -o animasm animasm.cpp
+ *      animasm [-v] animations.anim [main.cpp]
+ *
+ *  With a target file the tables replace the generated block in place,
+ *  otherwise they are written to stdout. -v prints size and duration
+ *  of every animation.
+ *
+ *  Script syntax, one command per line, '#' starts a comment:
+ *
+ *      anim <name>             start a table
+ *      settile <tile>          ANIM_CMD_SETTILE
+ *      sprite <index>          ANIM_CMD_SETSPRITE
+ *      spriteoff               ANIM_CMD_TURNOFFSPRITE
+ *      attr <flags>            ANIM_CMD_SETSPRITEATTR
+ *      flip <flags>            ANIM_CMD_FLIP_SPRITE_ATTR
+ *      move <dx> <dy>          ANIM_CMD_MOVE, dx along the owner direction
+ *      event <id>              ANIM_CMD_EVENT
+ *      delay <frames>          ANIM_CMD_DELAY or ANIM_CMD_DELAY16
+ *      repeat <count>          start of a ANIM_CMD_LOOP body
+ *      loop                    end of the loop body
+ *      end                     ANIM_CMD_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#define BEGIN_MARKER    "//animations, generated from animations.anim by tools/animasm.cpp"
+#define END_MARKER      "//end of animations"
+
+#define MAX_DELAY16     65535
+#define MAX_LOOP_BODY   (255 - 3)
+
+typedef struct Item {
+    std::string text;   //C expression emitted in the table
+    int size;           //bytes
+    bool lineBreak;     //last item of a frame
+} Item;
+
+typedef struct Anim {
+    std::string name;
+    std::vector<Item> items;
+    int size;
+    long frames;
+} Anim;
+
+static const char *fileName;
+static int lineNo;
+static int errors;
+
+static void error(const char *msg, const char *arg = "") {
+    fprintf(stderr, "%s:%d: %s%s\n", fileName, lineNo, msg, arg);
+    errors++;
+}
+
+static bool parseNumber(const std::string &s, long *value) {
+    char *end;
+    *value = strtol(s.c_str(), &end, 0);
+    return !s.empty() && *end == '\0';
+}
+
+static void emit(Anim &anim, const std::string &text, int size = 1, bool lineBreak = false) {
+    Item item;
+    item.text = text;
+    item.size = size;
+    item.lineBreak = lineBreak;
+    anim.items.push_back(item);
+    anim.size += size;
+}
+
+static std::string hexByte(long value) {
+    char buf[8];
+    sprintf(buf, "0x%02x", (unsigned)(value & 0xff));
+    return buf;
+}
+
+static std::vector<Anim> assemble(FILE *fp) {
+    std::vector<Anim> anims;
+    Anim *anim = NULL;
+    int loopStart = -1, loopCount = 0;
+    long loopFrames = 0, frames = 0;
+    bool loopHasDelay = false;
+    char buf[512];
+
+    lineNo = 0;
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        lineNo++;
+
+        char *comment = strchr(buf, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        std::vector<std::string> tok;
+        for (char *p = strtok(buf, " \t\r\n"); p != NULL; p = strtok(NULL, " \t\r\n")) {
+            tok.push_back(p);
+        }
+        if (tok.empty())
+            continue;
+
+        const std::string &cmd = tok[0];
+        size_t operands = tok.size() - 1;
+
+        if (cmd == "anim") {
+            if (anim != NULL) {
+                error("missing end of ", anim->name.c_str());
+            }
+            if (operands != 1) {
+                error("usage: anim <name>");
+                continue;
+            }
+            for (size_t i = 0; i < anims.size(); i++) {
+                if (anims[i].name == tok[1])
+                    error("duplicate animation ", tok[1].c_str());
+            }
+            anims.push_back(Anim());
+            anim = &anims.back();
+            anim->name = tok[1];
+            anim->size = 0;
+            anim->frames = 0;
+            frames = 0;
+            loopStart = -1;
+            continue;
+        }
+
+        if (anim == NULL) {
+            error("command outside of an animation: ", cmd.c_str());
+            continue;
+        }
+
+        long value, value2;
+
+        if (cmd == "end") {
+            if (operands != 0)
+                error("end takes no operands");
+            if (loopStart != -1)
+                error("repeat without loop");
+            if (anim->items.empty())
+                error("empty animation ", anim->name.c_str());
+            emit(*anim, "ANIM_CMD_END", 1, true);
+            anim->frames = frames;
+            anim = NULL;
+
+        } else if (cmd == "settile" || cmd == "sprite" || cmd == "attr" || cmd == "flip" || cmd == "event") {
+            static const char *opcodes[][2] = {
+                { "settile", "ANIM_CMD_SETTILE" },
+                { "sprite", "ANIM_CMD_SETSPRITE" },
+                { "attr", "ANIM_CMD_SETSPRITEATTR" },
+                { "flip", "ANIM_CMD_FLIP_SPRITE_ATTR" },
+                { "event", "ANIM_CMD_EVENT" },
+            };
+            if (operands != 1) {
+                error("expected one operand for ", cmd.c_str());
+                continue;
+            }
+            if (parseNumber(tok[1], &value) && (value < 0 || value > 255)) {
+                error("operand out of range 0..255: ", tok[1].c_str());
+            }
+            for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); i++) {
+                if (cmd == opcodes[i][0])
+                    emit(*anim, opcodes[i][1]);
+            }
+            emit(*anim, tok[1]);
+
+        } else if (cmd == "spriteoff") {
+            if (operands != 0)
+                error("spriteoff takes no operands");
+            emit(*anim, "ANIM_CMD_TURNOFFSPRITE");
+
+        } else if (cmd == "move") {
+            if (operands != 2 || !parseNumber(tok[1], &value) || !parseNumber(tok[2], &value2)) {
+                error("usage: move <dx> <dy>");
+                continue;
+            }
+            if (value < -128 || value > 127 || value2 < -128 || value2 > 127) {
+                error("move displacement out of range -128..127");
+            }
+            emit(*anim, "ANIM_CMD_MOVE");
+            emit(*anim, hexByte(value));
+            emit(*anim, hexByte(value2));
+
+        } else if (cmd == "delay") {
+            if (operands != 1 || !parseNumber(tok[1], &value)) {
+                error("usage: delay <frames>");
+                continue;
+            }
+            if (value < 0 || value > MAX_DELAY16) {
+                error("delay out of range: ", tok[1].c_str());
+                continue;
+            }
+            if (value <= 0x7f) {
+                emit(*anim, "ANIM_CMD_DELAY|" + tok[1], 1, true);
+            } else {
+                emit(*anim, "ANIM_CMD_DELAY16");
+                emit(*anim, hexByte(value));
+                emit(*anim, hexByte(value >> 8), 1, true);
+            }
+            frames += value + 1;
+            loopHasDelay = true;
+
+        } else if (cmd == "repeat") {
+            if (operands != 1 || !parseNumber(tok[1], &value)) {
+                error("usage: repeat <count>");
+                continue;
+            }
+            if (loopStart != -1) {
+                error("nested loops are not supported");
+                continue;
+            }
+            if (value < 2 || value > 255) {
+                error("repeat count out of range 2..255: ", tok[1].c_str());
+            }
+            loopStart = anim->size;
+            loopCount = value;
+            loopFrames = frames;
+            loopHasDelay = false;
+
+        } else if (cmd == "loop") {
+            if (loopStart == -1) {
+                error("loop without repeat");
+                continue;
+            }
+            int body = anim->size - loopStart;
+            if (body == 0) {
+                error("empty loop body");
+            } else if (body > MAX_LOOP_BODY) {
+                error("loop body too long");
+            }
+            if (!loopHasDelay) {
+                error("loop body without delay");
+            }
+            emit(*anim, "ANIM_CMD_LOOP");
+            emit(*anim, std::to_string(loopCount));
+            emit(*anim, std::to_string(body + 3));
+            frames += (frames - loopFrames) * (loopCount - 1);
+            loopStart = -1;
+
+        } else {
+            error("unknown command ", cmd.c_str());
+        }
+    }
+
+    if (anim != NULL) {
+        error("missing end of ", anim->name.c_str());
+    }
+
+    return anims;
+}
+
+static std::string generate(const std::vector<Anim> &anims) {
+    std::string out;
+
+    out += BEGIN_MARKER "\n";
+    for (size_t i = 0; i < anims.size(); i++) {
+        const Anim &anim = anims[i];
+
+        out += "const u8 " + anim.name + "[] PROGMEM = {\n    ";
+        for (size_t j = 0; j < anim.items.size(); j++) {
+            const Item &item = anim.items[j];
+            out += item.text;
+            if (j == anim.items.size() - 1) {
+                out += "\n";
+            } else if (item.lineBreak) {
+                out += ",\n    ";
+            } else {
+                out += ", ";
+            }
+        }
+        out += "};\n";
+    }
+    out += END_MARKER "\n";
+
+    return out;
+}
+
+static bool replaceBlock(const char *path, const std::string &block) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        text.append(buf, n);
+    }
+    fclose(fp);
+
+    size_t begin = text.find(BEGIN_MARKER);
+    size_t end = text.find(END_MARKER);
+    if (begin == std::string::npos || end == std::string::npos || end < begin) {
+        fprintf(stderr, "%s: generated animations block not found\n", path);
+        return false;
+    }
+    end = text.find('\n', end);
+    end = (end == std::string::npos) ? text.size() : end + 1;
+
+    text.replace(begin, end - begin, block);
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    bool verbose = false;
+    int arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        verbose = true;
+        arg++;
+    }
+    if (arg >= argc || argc - arg > 2) {
+        fprintf(stderr, "usage: %s [-v] <script.anim> [target.cpp]\n", argv[0]);
+        return 2;
+    }
+
+    fileName = argv[arg];
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL) {
+        perror(fileName);
+        return 2;
+    }
+    std::vector<Anim> anims = assemble(fp);
+    fclose(fp);
+
+    if (errors != 0) {
+        return 1;
+    }
+
+    if (verbose) {
+        for (size_t i = 0; i < anims.size(); i++) {
+            fprintf(stderr, "%-24s %4d bytes %6ld frames\n", anims[i].name.c_str(), anims[i].size, anims[i].frames);
+        }
+    }
+
+    std::string block = generate(anims);
+    if (arg + 1 < argc) {
+        return replaceBlock(argv[arg + 1], block) ? 0 : 1;
+    }
+    fputs(block.c_str(), stdout);
+
+    return 0;
+}
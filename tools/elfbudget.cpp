@@ -0,0 +1,570 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Host side memory budget report for cpu.elf and gpu.elf.
+ *
+ *      g++ -O2 -o elfbudget elfbudget.cpp
+ *      elfbudget [options] build.elf [new.elf]
+ *
+ *      -s <path>       attribute symbols to a source file or to the sources
+ *                      in a directory, can be repeated
+ *      -n <count>      number of symbols listed, default 20
+ *      --hub <bytes>   fail if the hub image goes past bytes
+ *      --drivers <bytes>  fail if the .drivers section is larger than bytes
+ *      --fcache        fail if a function marked FCACHE in the sources is
+ *                      larger than the fcache area of the LMM kernel
+ *
+ *  With two files the second build is compared with the first one and
+ *  the budgets are checked on the second. Exit code is 1 when a budget
+ *  is exceeded, 2 on errors.
+ *
+ *  The functions marked FCACHE are found with -s, they are listed by the
+ *  report and a marked function missing from the build fails the check.
+ *  The fcache area runs from __LMM_FCACHE_START to the next symbol of the
+ *  kernel image, 512 bytes in the propgcc LMM kernel.
+ *
+ *  Names defined in more than one source (main in main.cpp and gpu.cpp)
+ *  are left unattributed, pass the single files to resolve them.
+ *
+ *  The linker leaves all symbol sizes to 0, sizes are the distance to the
+ *  next symbol of the same section. Cog images (drivers, LMM kernel) are
+ *  stored in hub or in EEPROM at their load address and are counted as a
+ *  whole. The LMM kernel image is overwritten by .bss once started so the
+ *  hub image top, not the sum of the sections, is what limits the stack.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+#define HUB_SIZE        0x8000
+#define EEPROM_BASE     0xc0000000
+
+#define SHT_SYMTAB      2
+#define SHT_NOBITS      8
+#define SHF_ALLOC       0x2
+#define SHF_EXECINSTR   0x4
+#define SHF_MASKPROC    0xf0000000
+#define PT_LOAD         1
+#define STT_SECTION     3
+#define STT_FILE        4
+#define SHN_UNDEF       0
+#define SHN_LORESERVE   0xff00
+
+typedef struct Section {
+    std::string name;
+    unsigned long addr;     //run address
+    unsigned long lma;      //load address, hub or EEPROM
+    unsigned long size;
+    unsigned long flags;
+    bool cogImage;          //runs from cog memory, counted as a whole
+} Section;
+
+typedef struct Symbol {
+    std::string name;       //without the C prefix and C++ mangling
+    std::string module;
+    unsigned long addr;
+    unsigned long size;
+    int section;
+} Symbol;
+
+typedef struct Elf {
+    const char *path;
+    std::vector<Section> sections;
+    std::vector<Symbol> symbols;
+    unsigned long hubTop;
+    unsigned long eeprom;
+    unsigned long drivers;
+    unsigned long fcache;   //bytes of the fcache area, 0 if not found
+} Elf;
+
+static std::map<std::string, std::string> sourceOf;
+static std::set<std::string> fcacheKernels;
+
+static unsigned long get16(const std::vector<unsigned char> &d, unsigned long ofs) {
+    return d[ofs] | (d[ofs + 1] << 8);
+}
+
+static unsigned long get32(const std::vector<unsigned char> &d, unsigned long ofs) {
+    return d[ofs] | (d[ofs + 1] << 8) | (d[ofs + 2] << 16) | ((unsigned long) d[ofs + 3] << 24);
+}
+
+//_patch02 -> patch02, __Z13ProcessPlayerh -> ProcessPlayer, __ZL6levels -> levels
+static std::string demangle(const char *s) {
+    if (*s == '_')
+        s++;
+    if (s[0] != '_' || s[1] != 'Z')
+        return s;
+
+    s += 2;
+    if (*s == 'L')
+        s++;
+    char *end;
+    long len = strtol(s, &end, 10);
+    if (end == s || len <= 0 || (long) strlen(end) < len)
+        return s;
+
+    return std::string(end, len);
+}
+
+static bool isHubSymbol(const std::string &name) {
+    //compiler local labels split the functions, string literals (.LC) are kept
+    return !(name.size() > 2 && name[0] == '.' && name[1] == 'L' && name[2] >= '0' && name[2] <= '9');
+}
+
+static bool load(const char *path, Elf &elf) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+
+    std::vector<unsigned char> d;
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        d.insert(d.end(), buf, buf + n);
+    }
+    fclose(fp);
+
+    if (d.size() < 52 || memcmp(&d[0], "\177ELF", 4) != 0 || d[4] != 1 || d[5] != 1) {
+        fprintf(stderr, "%s: not a 32 bit little endian ELF file\n", path);
+        return false;
+    }
+
+    elf.path = path;
+    unsigned long phoff = get32(d, 0x1c), shoff = get32(d, 0x20);
+    unsigned long phnum = get16(d, 0x2c), shnum = get16(d, 0x30), shstrndx = get16(d, 0x32);
+    if (shoff + shnum * 40 > d.size() || phoff + phnum * 32 > d.size() || shstrndx >= shnum) {
+        fprintf(stderr, "%s: truncated ELF file\n", path);
+        return false;
+    }
+
+    unsigned long strOfs = get32(d, shoff + shstrndx * 40 + 16);
+    unsigned long symtab = 0, symtabOfs = 0, symtabSize = 0, symstrOfs = 0;
+
+    for (unsigned long i = 0; i < shnum; i++) {
+        unsigned long sh = shoff + i * 40;
+        Section s;
+        unsigned long type = get32(d, sh + 4), offset = get32(d, sh + 16);
+
+        s.name = (const char *) &d[strOfs + get32(d, sh)];
+        s.flags = get32(d, sh + 8);
+        s.addr = get32(d, sh + 12);
+        s.size = get32(d, sh + 20);
+        s.cogImage = (s.flags & SHF_MASKPROC) != 0 || s.name == ".lmmkernel";
+        s.lma = s.addr;
+
+        //the load address comes from the segment holding the section data
+        if (type != SHT_NOBITS) {
+            for (unsigned long j = 0; j < phnum; j++) {
+                unsigned long ph = phoff + j * 32;
+                unsigned long pOffset = get32(d, ph + 4), pFilesz = get32(d, ph + 16);
+                if (get32(d, ph) == PT_LOAD && offset >= pOffset && offset < pOffset + pFilesz) {
+                    s.lma = get32(d, ph + 12) + (offset - pOffset);
+                    break;
+                }
+            }
+        }
+
+        if (type == SHT_SYMTAB) {
+            symtab = i;
+            symtabOfs = offset;
+            symtabSize = s.size;
+            symstrOfs = get32(d, shoff + get32(d, sh + 24) * 40 + 16);
+        }
+        elf.sections.push_back(s);
+    }
+
+    if (symtab == 0) {
+        fprintf(stderr, "%s: no symbol table\n", path);
+        return false;
+    }
+
+    //symbols, the module is the last FILE symbol seen for locals
+    std::string module = "(other)";
+    std::vector<unsigned long> kernel;
+    unsigned long fcacheStart = 0;
+    for (unsigned long ofs = symtabOfs; ofs + 16 <= symtabOfs + symtabSize; ofs += 16) {
+        const char *name = (const char *) &d[symstrOfs + get32(d, ofs)];
+        unsigned long info = d[ofs + 12], shndx = get16(d, ofs + 14);
+
+        if ((info & 0x0f) == STT_FILE) {
+            const char *base = strrchr(name, '/');
+            module = base != NULL ? base + 1 : name;
+            continue;
+        }
+        if ((info & 0x0f) == STT_SECTION || shndx == SHN_UNDEF || shndx >= SHN_LORESERVE || shndx >= shnum)
+            continue;
+        if (elf.sections[shndx].name == ".lmmkernel") {
+            unsigned long addr = get32(d, ofs + 4);
+            kernel.push_back(addr);
+            if (strcmp(name, "__LMM_FCACHE_START") == 0)
+                fcacheStart = addr;
+        }
+        if (!(elf.sections[shndx].flags & SHF_ALLOC) || elf.sections[shndx].cogImage || !isHubSymbol(name))
+            continue;
+
+        Symbol sym;
+        sym.name = demangle(name);
+        sym.addr = get32(d, ofs + 4);
+        sym.section = shndx;
+        sym.size = 0;
+        sym.module = (info >> 4) == 0 ? module : "(other)";
+
+        std::map<std::string, std::string>::iterator src = sourceOf.find(sym.name);
+        if (src != sourceOf.end() && !src->second.empty()) {
+            sym.module = src->second;
+        } else if (name[0] == '.') {
+            sym.module = "(literals)";
+        }
+        elf.symbols.push_back(sym);
+    }
+
+    elf.fcache = 0;
+    if (fcacheStart != 0) {
+        unsigned long end = ~0ul;
+        for (size_t i = 0; i < kernel.size(); i++) {
+            if (kernel[i] > fcacheStart && kernel[i] < end)
+                end = kernel[i];
+        }
+        if (end != ~0ul)
+            elf.fcache = end - fcacheStart;
+    }
+
+    //sizes from the distance to the next symbol, aliases are merged
+    std::sort(elf.symbols.begin(), elf.symbols.end(), [](const Symbol &a, const Symbol &b) {
+        return a.section != b.section ? a.section < b.section : a.addr < b.addr;
+    });
+    std::vector<Symbol> merged;
+    for (size_t i = 0; i < elf.symbols.size(); i++) {
+        if (!merged.empty() && merged.back().section == elf.symbols[i].section && merged.back().addr == elf.symbols[i].addr) {
+            merged.back().name += "=" + elf.symbols[i].name;
+            if (merged.back().module == "(other)")
+                merged.back().module = elf.symbols[i].module;
+            continue;
+        }
+        merged.push_back(elf.symbols[i]);
+    }
+    for (size_t i = 0; i < merged.size(); i++) {
+        const Section &s = elf.sections[merged[i].section];
+        unsigned long next = s.addr + s.size;
+        if (i + 1 < merged.size() && merged[i + 1].section == merged[i].section)
+            next = merged[i + 1].addr;
+        merged[i].size = next > merged[i].addr ? next - merged[i].addr : 0;
+    }
+    elf.symbols = merged;
+
+    //cog images are a single block named after the section
+    elf.hubTop = 0;
+    elf.eeprom = 0;
+    elf.drivers = 0;
+    for (size_t i = 0; i < elf.sections.size(); i++) {
+        const Section &s = elf.sections[i];
+        if (!(s.flags & SHF_ALLOC) || s.size == 0)
+            continue;
+
+        if (s.lma >= EEPROM_BASE) {
+            elf.eeprom += s.size;
+        } else if (s.lma + s.size > elf.hubTop) {
+            elf.hubTop = s.lma + s.size;
+        }
+        if (s.name == ".drivers")
+            elf.drivers = s.size;
+
+        if (s.cogImage) {
+            Symbol sym;
+            sym.name = s.name;
+            sym.module = "(cog image)";
+            sym.addr = s.lma;
+            sym.size = s.size;
+            sym.section = i;
+            elf.symbols.push_back(sym);
+        }
+    }
+
+    return true;
+}
+
+//file scope definitions: the first identifier followed by one of [ ( = ;
+//or PROGMEM, on a line that is not indented, an empty module marks a name
+//defined in several files. FCACHE on its own line marks the next definition
+static void scanSource(const std::string &path, const std::string &module) {
+    FILE *fp = fopen(path.c_str(), "r");
+    if (fp == NULL)
+        return;
+
+    char line[1024];
+    bool fcache = false;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "FCACHE", 6) == 0 && isspace((unsigned char) line[6])) {
+            fcache = true;
+            continue;
+        }
+        if (line[0] == ' ' || line[0] == '\t' || line[0] == '#' || line[0] == '/' || line[0] == '}' || line[0] == '\n')
+            continue;
+        if (strncmp(line, "extern", 6) == 0)
+            continue;
+
+        for (char *p = line; *p != '\0'; ) {
+            if (!(isalpha((unsigned char) *p) || *p == '_')) {
+                if (*p == '=' || *p == '(' || *p == '{')
+                    break;
+                p++;
+                continue;
+            }
+            char *start = p;
+            while (isalnum((unsigned char) *p) || *p == '_')
+                p++;
+            std::string id(start, p - start);
+            char *q = p;
+            while (*q == ' ' || *q == '*')
+                q++;
+            if (*q == '[' || *q == '(' || *q == '=' || *q == ';' || strncmp(q, "PROGMEM", 7) == 0) {
+                std::map<std::string, std::string>::iterator it = sourceOf.find(id);
+                if (it == sourceOf.end()) {
+                    sourceOf[id] = module;
+                } else if (it->second != module) {
+                    it->second = "";
+                }
+                if (fcache)
+                    fcacheKernels.insert(id);
+                fcache = false;
+                break;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+static void scanSources(const char *path) {
+    DIR *dp = opendir(path);
+    if (dp == NULL) {
+        const char *base = strrchr(path, '/');
+        scanSource(path, base != NULL ? base + 1 : path);
+        return;
+    }
+
+    std::vector<std::string> files;
+    struct dirent *de;
+    while ((de = readdir(dp)) != NULL) {
+        std::string name = de->d_name;
+        size_t dot = name.rfind('.');
+        if (dot != std::string::npos && (name.substr(dot) == ".cpp" || name.substr(dot) == ".c" || name.substr(dot) == ".h"))
+            files.push_back(name);
+    }
+    closedir(dp);
+
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size(); i++) {
+        scanSource(std::string(path) + "/" + files[i], files[i]);
+    }
+}
+
+static const char *region(const Elf &elf, const Symbol &sym) {
+    const Section &s = elf.sections[sym.section];
+    if (s.lma >= EEPROM_BASE)
+        return "eeprom";
+    if (s.cogImage)
+        return "cog";
+    if (s.flags & SHF_EXECINSTR)
+        return "code";
+    return s.name == ".bss" || s.name == ".hub_heap" ? "bss" : "data";
+}
+
+//symbol of a function, aliases are merged as name=other
+static const Symbol *findSymbol(const Elf &elf, const std::string &name) {
+    for (size_t i = 0; i < elf.symbols.size(); i++) {
+        const std::string &s = elf.symbols[i].name;
+        size_t pos = s.find(name);
+        if (pos != std::string::npos && (pos == 0 || s[pos - 1] == '=') && (pos + name.size() == s.size() || s[pos + name.size()] == '='))
+            return &elf.symbols[i];
+    }
+    return NULL;
+}
+
+static std::map<std::string, unsigned long> moduleTotals(const Elf &elf) {
+    std::map<std::string, unsigned long> totals;
+    for (size_t i = 0; i < elf.symbols.size(); i++) {
+        totals[elf.symbols[i].module + " " + region(elf, elf.symbols[i])] += elf.symbols[i].size;
+    }
+    return totals;
+}
+
+static void report(const Elf &elf, int count) {
+    printf("%s\n\n", elf.path);
+    printf("  %-26s %10s %10s %8s\n", "section", "address", "load", "bytes");
+    for (size_t i = 0; i < elf.sections.size(); i++) {
+        const Section &s = elf.sections[i];
+        if ((s.flags & SHF_ALLOC) && s.size != 0)
+            printf("  %-26s 0x%08lx 0x%08lx %8lu%s\n", s.name.c_str(), s.addr, s.lma, s.size, s.cogImage ? "  cog image" : "");
+    }
+
+    printf("\n  hub image top %lu bytes, %ld left for stack and heap\n", elf.hubTop, (long) HUB_SIZE - (long) elf.hubTop);
+    printf("  eeprom %lu bytes, .drivers %lu bytes\n\n", elf.eeprom, elf.drivers);
+
+    std::map<std::string, unsigned long> totals = moduleTotals(elf);
+    printf("  %-34s %8s\n", "module", "bytes");
+    for (std::map<std::string, unsigned long>::iterator it = totals.begin(); it != totals.end(); it++) {
+        printf("  %-34s %8lu\n", it->first.c_str(), it->second);
+    }
+
+    if (!fcacheKernels.empty()) {
+        printf("\n  %-34s %8s\n", "fcache kernel", "bytes");
+        printf("  %-34s %8lu\n", "(fcache area)", elf.fcache);
+        for (std::set<std::string>::iterator it = fcacheKernels.begin(); it != fcacheKernels.end(); it++) {
+            const Symbol *sym = findSymbol(elf, *it);
+            if (sym != NULL) {
+                printf("  %-34s %8lu\n", it->c_str(), sym->size);
+            } else {
+                printf("  %-34s %8s\n", it->c_str(), "missing");
+            }
+        }
+    }
+
+    std::vector<Symbol> bySize = elf.symbols;
+    std::stable_sort(bySize.begin(), bySize.end(), [](const Symbol &a, const Symbol &b) {
+        return a.size > b.size;
+    });
+    printf("\n  %-34s %-6s %-16s %8s\n", "symbol", "region", "module", "bytes");
+    for (int i = 0; i < count && i < (int) bySize.size(); i++) {
+        printf("  %-34s %-6s %-16s %8lu\n", bySize[i].name.c_str(), region(elf, bySize[i]), bySize[i].module.c_str(), bySize[i].size);
+    }
+}
+
+static void printDelta(const char *label, long a, long b) {
+    if (a != b)
+        printf("  %-40s %8ld %8ld %+8ld\n", label, a, b, b - a);
+}
+
+static void diff(const Elf &a, const Elf &b) {
+    printf("%s -> %s\n\n", a.path, b.path);
+    printf("  %-40s %8s %8s %8s\n", "", "old", "new", "delta");
+    printDelta("hub image top", a.hubTop, b.hubTop);
+    printDelta("eeprom", a.eeprom, b.eeprom);
+
+    std::map<std::string, std::pair<long, long> > rows;
+    for (size_t i = 0; i < a.sections.size(); i++) {
+        if (a.sections[i].flags & SHF_ALLOC)
+            rows["section " + a.sections[i].name].first = a.sections[i].size;
+    }
+    for (size_t i = 0; i < b.sections.size(); i++) {
+        if (b.sections[i].flags & SHF_ALLOC)
+            rows["section " + b.sections[i].name].second = b.sections[i].size;
+    }
+
+    std::map<std::string, unsigned long> ta = moduleTotals(a), tb = moduleTotals(b);
+    for (std::map<std::string, unsigned long>::iterator it = ta.begin(); it != ta.end(); it++) {
+        rows["module " + it->first].first = it->second;
+    }
+    for (std::map<std::string, unsigned long>::iterator it = tb.begin(); it != tb.end(); it++) {
+        rows["module " + it->first].second = it->second;
+    }
+
+    for (size_t i = 0; i < a.symbols.size(); i++) {
+        rows[a.symbols[i].name].first += a.symbols[i].size;
+    }
+    for (size_t i = 0; i < b.symbols.size(); i++) {
+        rows[b.symbols[i].name].second += b.symbols[i].size;
+    }
+
+    for (std::map<std::string, std::pair<long, long> >::iterator it = rows.begin(); it != rows.end(); it++) {
+        printDelta(it->first.c_str(), it->second.first, it->second.second);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long hubBudget = -1, driversBudget = -1;
+    bool fcacheCheck = false;
+    int count = 20;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scanSources(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hub") == 0 && i + 1 < argc) {
+            hubBudget = strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--drivers") == 0 && i + 1 < argc) {
+            driversBudget = strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--fcache") == 0) {
+            fcacheCheck = true;
+        } else if (argv[i][0] != '-') {
+            files.push_back(argv[i]);
+        } else {
+            files.clear();
+            break;
+        }
+    }
+    if (files.empty() || files.size() > 2) {
+        fprintf(stderr, "usage: %s [-s source] [-n count] [--hub bytes] [--drivers bytes] [--fcache] build.elf [new.elf]\n", argv[0]);
+        return 2;
+    }
+
+    Elf elf[2];
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!load(files[i], elf[i]))
+            return 2;
+    }
+
+    if (files.size() == 1) {
+        report(elf[0], count);
+    } else {
+        diff(elf[0], elf[1]);
+    }
+
+    const Elf &last = elf[files.size() - 1];
+    int result = 0;
+    if (hubBudget >= 0 && (long) last.hubTop > hubBudget) {
+        fprintf(stderr, "%s: hub image is %lu bytes, budget is %ld\n", last.path, last.hubTop, hubBudget);
+        result = 1;
+    }
+    if (driversBudget >= 0 && (long) last.drivers > driversBudget) {
+        fprintf(stderr, "%s: .drivers is %lu bytes, budget is %ld\n", last.path, last.drivers, driversBudget);
+        result = 1;
+    }
+    if (fcacheCheck && last.fcache == 0) {
+        fprintf(stderr, "%s: no __LMM_FCACHE_START in the LMM kernel\n", last.path);
+        result = 1;
+    } else if (fcacheCheck) {
+        for (std::set<std::string>::iterator it = fcacheKernels.begin(); it != fcacheKernels.end(); it++) {
+            const Symbol *sym = findSymbol(last, *it);
+            if (sym == NULL) {
+                fprintf(stderr, "%s: fcache kernel %s is not in the build\n", last.path, it->c_str());
+                result = 1;
+            } else if (sym->size > last.fcache) {
+                fprintf(stderr, "%s: fcache kernel %s is %lu bytes, the fcache area is %lu\n", last.path, it->c_str(), sym->size, last.fcache);
+                result = 1;
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,62 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Runs the micro benchmarks of src/bench.cpp on the host, the game is built
+ *  as for the other host tools and the results are in nanoseconds per call.
+ *
+ *      p8xgen -o build src/Princesse.p8x
+ *      g++ -O2 -std=gnu++11 -funsigned-char -Wno-narrowing -Itools/host -Ibuild \
+ *          -o bench tools/host/bench.cpp tools/host/host.cpp
+ *      bench
+ *
+ *  Only the ratios between a reference and its replacement carry over to
+ *  the target, where the LMM kernel and the hub access pattern dominate.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCHMARK
+#define BENCH_HOST
+
+#include "game.cpp"
+
+static uint32_t BenchClock() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000000000u + (uint32_t)now.tv_nsec;
+}
+
+//src/bench.cpp reads CNT, the system counter, nanoseconds instead here
+#undef CNT
+#define CNT                 BenchClock()
+
+#include "../../src/bench.cpp"
+
+int main() {
+    HostFrame frame;
+
+    HostStartLevel(0, 1, &frame);
+    printf("%-16s %12s\n", "BENCHMARK", "NS/CALL");
+    RunBenchmarks();
+    return 0;
+}
@@ -0,0 +1,394 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Coverage guided fuzzer of the player and enemy state machines.
+ *
+ *      p8xgen -o build src/Princesse.p8x
+ *      g++ -O2 -std=gnu++11 -funsigned-char -Wno-narrowing -Itools/host -Ibuild \
+ *          -fsanitize-coverage=trace-pc -c tools/host/game.cpp -o build/game_cov.o
+ *      g++ -O2 -std=gnu++11 -Itools/host -Ibuild -o fuzz tools/host/fuzz.cpp tools/host/host.cpp build/game_cov.o
+ *      fuzz [-t seconds] [-s seed] [-f frames] [-o dir]
+ *      fuzz -r case
+ *
+ *  A case is a level, a seed and a joypad stream (buttons held for a number
+ *  of frames). Cases are mutated from a corpus and kept when they reach new
+ *  code in the game (basic block hit counts, bucketed as in AFL) or a new pair of
+ *  actions for an entity. Every frame checks the invariants of game.h: vram
+ *  indexing in bounds, valid gold ids and entities inside the 28x16 field.
+ *
+ *  The first case breaking each invariant is written to dir/failure-N.case
+ *  and can be replayed with -r. START is never pressed, the pause menu is a
+ *  task of the scheduler and the host only runs the gameplay frames.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "game.h"
+
+#define BTN_UP              16
+#define BTN_DOWN            32
+#define BTN_LEFT            64
+#define BTN_RIGHT           128
+#define BTN_A               256
+
+#define MAX_EDGES           (1 << 16)
+#define MAX_STEPS           256
+#define MAX_STEP_FRAMES     40
+#define ACTIONS             16      //room for every ACTION_*
+
+typedef struct Step {
+    uint16_t buttons;
+    uint8_t frames;
+} Step;
+
+typedef struct Case {
+    int level;
+    uint32_t seed;
+    std::vector<Step> steps;
+} Case;
+
+static const uint16_t buttonChoices[] = {
+    0, BTN_LEFT, BTN_RIGHT, BTN_UP, BTN_DOWN, BTN_A,
+    BTN_A | BTN_LEFT, BTN_A | BTN_RIGHT, BTN_UP | BTN_LEFT, BTN_DOWN | BTN_RIGHT
+};
+
+//block coverage of game.cpp, filled by the trace-pc callback
+static bool traced;
+static uint8_t edgeHits[MAX_EDGES];
+static uint8_t edgeSeen[MAX_EDGES];             //hit count buckets seen so far
+static uint8_t actionSeen[2][ACTIONS][ACTIONS]; //enemy/player, previous action, action
+
+static uint64_t randomState = 0x9e3779b97f4a7c15ULL;
+static int maxFrames = 3000;
+
+extern "C" void __sanitizer_cov_trace_pc() {
+    uintptr_t pc = (uintptr_t) __builtin_return_address(0);
+    uint32_t edge = (uint32_t) ((pc ^ (pc >> 16)) * 0x9e3779b1u) >> 16;
+
+    traced = true;
+    if (edgeHits[edge] != 255) {
+        edgeHits[edge]++;
+    }
+}
+
+static uint32_t Random(uint32_t range) {
+    //xorshift64*
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return (uint32_t) ((randomState * 0x2545f4914f6cdd1dULL) >> 32) % range;
+}
+
+static Step RandomStep() {
+    Step step;
+
+    step.buttons = buttonChoices[Random(sizeof(buttonChoices) / sizeof(buttonChoices[0]))];
+    step.frames = 1 + Random(MAX_STEP_FRAMES);
+    return step;
+}
+
+static uint8_t HitBucket(uint8_t hits) {
+    if (hits <= 3)
+        return 1 << (hits - 1);
+    if (hits <= 7)
+        return 8;
+    if (hits <= 15)
+        return 16;
+    if (hits <= 31)
+        return 32;
+    if (hits <= 127)
+        return 64;
+    return 128;
+}
+
+typedef struct Outcome {
+    int frames;
+    bool failed;
+    HostFailure failure;
+    bool interesting;       //reached something new
+} Outcome;
+
+static Outcome Run(const Case *c) {
+    Outcome outcome;
+    HostFrame frame;
+    uint8_t last[HOST_ENTITIES];
+    int frames = 0;
+
+    memset(&outcome, 0, sizeof(outcome));
+    memset(edgeHits, 0, sizeof(edgeHits));
+
+    try {
+        HostStartLevel(c->level, c->seed, &frame);
+        for (int e = 0; e < HOST_ENTITIES; e++) {
+            last[e] = frame.entity[e].action;
+        }
+
+        for (size_t s = 0; s < c->steps.size() && frame.result == HOST_PLAYING && frames < maxFrames; s++) {
+            for (int f = 0; f < c->steps[s].frames && frame.result == HOST_PLAYING && frames < maxFrames; f++) {
+                HostRunFrame(c->steps[s].buttons, &frame);
+                frames++;
+
+                for (int e = 0; e < HOST_ENTITIES; e++) {
+                    uint8_t action = frame.entity[e].action & (ACTIONS - 1);
+                    uint8_t *seen = &actionSeen[e == HOST_PLAYER][last[e]][action];
+
+                    if (frame.entity[e].active && !*seen) {
+                        *seen = 1;
+                        outcome.interesting = true;
+                    }
+                    last[e] = action;
+                }
+            }
+        }
+    } catch (const HostFailure &failure) {
+        outcome.failed = true;
+        outcome.failure = failure;
+    }
+    outcome.frames = frames;
+
+    for (uint32_t i = 0; i < MAX_EDGES; i++) {
+        if (edgeHits[i] != 0) {
+            uint8_t bucket = HitBucket(edgeHits[i]);
+
+            if ((edgeSeen[i] & bucket) == 0) {
+                edgeSeen[i] |= bucket;
+                outcome.interesting = true;
+            }
+        }
+    }
+
+    return outcome;
+}
+
+static void Mutate(Case *c, const std::vector<Case> &corpus) {
+    int count = 1 + Random(3);
+
+    while (count-- > 0) {
+        size_t at = c->steps.empty() ? 0 : Random(c->steps.size());
+
+        switch (Random(8)) {
+            case 0:
+                if (!c->steps.empty())
+                    c->steps[at].buttons = RandomStep().buttons;
+                break;
+            case 1:
+                if (!c->steps.empty())
+                    c->steps[at].frames = RandomStep().frames;
+                break;
+            case 2:
+            case 3:
+                if (c->steps.size() < MAX_STEPS)
+                    c->steps.insert(c->steps.begin() + at, RandomStep());
+                break;
+            case 4:
+                if (c->steps.size() > 1)
+                    c->steps.erase(c->steps.begin() + at);
+                break;
+            case 5: {
+                //splice the tail of another case of the same level
+                const Case *other = &corpus[Random(corpus.size())];
+                if (other->level == c->level && !other->steps.empty()) {
+                    size_t from = Random(other->steps.size());
+                    c->steps.resize(at);
+                    c->steps.insert(c->steps.end(), other->steps.begin() + from, other->steps.end());
+                    if (c->steps.size() > MAX_STEPS)
+                        c->steps.resize(MAX_STEPS);
+                }
+                break;
+            }
+            case 6:
+                c->seed = Random(0xffffffff);
+                break;
+            case 7:
+                if (Random(16) == 0)
+                    c->level = Random(HostLevelCount());
+                break;
+        }
+    }
+
+    if (c->steps.empty()) {
+        c->steps.push_back(RandomStep());
+    }
+}
+
+static bool WriteCase(const char *path, const Case *c) {
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+        return false;
+    fprintf(fp, "level %d\nseed %u\n#buttons frames\n", c->level + 1, c->seed);
+    for (size_t s = 0; s < c->steps.size(); s++) {
+        fprintf(fp, "0x%04x %u\n", c->steps[s].buttons, c->steps[s].frames);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool ReadCase(const char *path, Case *c) {
+    FILE *fp = fopen(path, "r");
+    char line[128];
+    unsigned buttons, frames;
+
+    if (fp == NULL)
+        return false;
+    c->level = 0;
+    c->seed = 1;
+    c->steps.clear();
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "level %d", &c->level) == 1) {
+            c->level--;
+        } else if (sscanf(line, "seed %u", &c->seed) == 1) {
+        } else if (line[0] != '#' && sscanf(line, "%x %u", &buttons, &frames) == 2) {
+            Step step = { (uint16_t) buttons, (uint8_t) frames };
+            c->steps.push_back(step);
+        }
+    }
+    fclose(fp);
+    return c->level >= 0 && c->level < HostLevelCount();
+}
+
+static void PrintFailure(const HostFailure *failure, int frames) {
+    printf("frame %d: %s:%d %s (%ld)\n", frames, failure->file, failure->line, failure->what, failure->value);
+}
+
+static void Usage() {
+    fprintf(stderr, "usage: fuzz [-t seconds] [-s seed] [-f frames] [-o dir]\n       fuzz -r case\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    const char *replay = NULL;
+    const char *dir = ".";
+    int seconds = 60;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || argv[i][2] != 0) {
+            Usage();
+        }
+        const char *arg = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 't':
+                seconds = atoi(arg);
+                break;
+            case 's':
+                randomState = strtoull(arg, NULL, 0) | 1;
+                break;
+            case 'f':
+                maxFrames = atoi(arg);
+                break;
+            case 'o':
+                dir = arg;
+                break;
+            case 'r':
+                replay = arg;
+                break;
+            default:
+                Usage();
+        }
+    }
+
+    if (replay != NULL) {
+        Case c;
+
+        if (!ReadCase(replay, &c)) {
+            fprintf(stderr, "fuzz: can't read %s\n", replay);
+            return 2;
+        }
+        Outcome outcome = Run(&c);
+        if (outcome.failed) {
+            PrintFailure(&outcome.failure, outcome.frames);
+            return 1;
+        }
+        printf("%d frames, no failure\n", outcome.frames);
+        return 0;
+    }
+
+
+    //one short random case per level to start from
+    std::vector<Case> corpus;
+    for (int level = 0; level < HostLevelCount(); level++) {
+        Case c;
+
+        c.level = level;
+        c.seed = Random(0xffffffff);
+        for (int s = 0; s < 16; s++) {
+            c.steps.push_back(RandomStep());
+        }
+        Run(&c);
+        corpus.push_back(c);
+    }
+    if (!traced) {
+        fprintf(stderr, "fuzz: game.cpp is not built with -fsanitize-coverage=trace-pc\n");
+    }
+
+    std::set<std::string> failures;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point report = start;
+    uint64_t runs = 0, frames = 0;
+
+    while (1) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+
+        if (now - report >= std::chrono::seconds(5) || elapsed >= seconds) {
+            uint32_t edges = 0;
+            for (uint32_t i = 0; i < MAX_EDGES; i++) {
+                edges += edgeSeen[i] != 0;
+            }
+            printf("%6.0fs %9llu runs %12llu frames %9.0f frames/s  corpus %5zu  blocks %5u  failures %zu\n",
+                elapsed, (unsigned long long) runs, (unsigned long long) frames, elapsed > 0 ? frames / elapsed : 0.0,
+                corpus.size(), edges, failures.size());
+            fflush(stdout);
+            report = now;
+            if (elapsed >= seconds)
+                break;
+        }
+
+        Case c = corpus[Random(corpus.size())];
+        Mutate(&c, corpus);
+        Outcome outcome = Run(&c);
+        runs++;
+        frames += outcome.frames;
+
+        if (outcome.failed) {
+            char key[256];
+            snprintf(key, sizeof(key), "%s:%d %s", outcome.failure.file, outcome.failure.line, outcome.failure.what);
+            if (failures.insert(key).second) {
+                char path[512];
+                snprintf(path, sizeof(path), "%s/failure-%zu.case", dir, failures.size());
+                WriteCase(path, &c);
+                printf("%s: level %d ", path, c.level + 1);
+                PrintFailure(&outcome.failure, outcome.frames);
+            }
+        } else if (outcome.interesting) {
+            corpus.push_back(c);
+        }
+    }
+
+    return failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//the cpu code units built for the host, in the order of the <cpu> list of
+//the project as the P8X IDE concatenates them. The AI and the input are run
+//on the calling thread and every global of the game is thread_local, so each
+//thread of a tool plays its own game. GAME_CHECK and the invariants checked
+//after each frame throw a HostFailure.
+#define GAME_STATE          thread_local
+#define GAME_CHECK(cond)    do { if (!(cond)) HostCheckFailed(#cond, __FILE__, __LINE__, 0); } while (0)
+#define FCACHE
+#define AI_SAME_COG
+#define INPUT_SAME_COG
+
+#include <uzebox.h>
+#include <retronitus.h>
+
+#include "game.h"
+
+#include "Princesse_prototypes.h"
+
+#define main GameMain
+#include "../../src/maps.cpp"
+#include "../../src/main.cpp"
+#include "../../src/ai.cpp"
+#include "../../src/input.cpp"
+#include "../../src/task.cpp"
+#include "../../src/patches.cpp"
+#include "../../src/misc.cpp"
+#undef main
+
+int HostLevelCount() {
+    return LEVELS_COUNT;
+}
+
+void HostReadFrame(HostFrame *frame, u16 searches, u16 pathHits, u16 skipped) {
+    frame->result = HOST_PLAYING;
+    if (player.died[SPR_INDEX_PLAYER]) {
+        frame->result = HOST_DIED;
+    } else if (game.levelComplete) {
+        frame->result = HOST_COMPLETE;
+    }
+
+    frame->stuckEnemies = 0;
+    for (u8 id = 0; id < SPR_INDEX_PLAYER; id++) {
+        if (player.active[id] && ai.stuckDelay[id] > 0) {
+            frame->stuckEnemies++;
+        }
+    }
+    frame->searches = ai.searches - searches;
+    frame->pathHits = ai.pathHits - pathHits;
+    frame->skipped = ai.skipped - skipped;
+    frame->goldLeft = game.goldCount - game.goldCollected;
+
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        frame->entity[id].x = player.x[id] >> 8;
+        frame->entity[id].y = player.y[id] >> 8;
+        frame->entity[id].action = player.action[id];
+        frame->entity[id].dir = player.dir[id];
+        frame->entity[id].active = player.active[id];
+    }
+}
+
+void HostStartLevel(int level, uint32_t seed, HostFrame *frame) {
+    u16 searches, pathHits, skipped;
+
+    //start from power up, nothing is left from the previous game of the thread
+    memset(&saveGame, 0, sizeof(saveGame));
+    memset(&game, 0, sizeof(game));
+    memset(&player, 0, sizeof(player));
+    memset(&aiMailbox, 0, sizeof(aiMailbox));
+    memset(&ai, 0, sizeof(ai));
+    memset(&rng, 0, sizeof(rng));
+    memset(&input, 0, sizeof(input));
+    aiReceived = 0;
+    memset(sprites, 0, sizeof(sprites));
+    ClearVram();
+    hostJoypad = 0;
+    hostFrame = 0;
+
+    InitTileTables();
+    InitAnimations();
+    SeedRandom(seed);
+    player.lives[SPR_INDEX_PLAYER] = 6;
+
+    searches = ai.searches;
+    pathHits = ai.pathHits;
+    skipped = ai.skipped;
+    UnpackGameMap(level);
+    HostReadFrame(frame, searches, pathHits, skipped);
+}
+
+#define HOST_CHECK(cond, value) \
+    do { if (!(cond)) HostCheckFailed(#cond, __FILE__, __LINE__, value); } while (0)
+
+void HostCheckInvariants() {
+    HOST_CHECK(game.goldCount <= MAX_GOLD, game.goldCount);
+    HOST_CHECK(game.goldCollected <= game.goldCount, game.goldCollected);
+    HOST_CHECK(game.holeCount <= MAX_HOLES, game.holeCount);
+
+    for (u8 i = 0; i < game.goldCount; i++) {
+        HOST_CHECK(game.gold[i].state <= GOLD_STATE_COLLECTED, i);
+        HOST_CHECK(game.gold[i].x >= 1 && game.gold[i].x <= FIELD_WIDTH, i);
+        HOST_CHECK(game.gold[i].y < FIELD_HEIGHT, i);
+    }
+
+    for (u8 id = 0; id < MAX_PLAYERS; id++) {
+        if (!player.active[id])
+            continue;
+
+        //inside the 28x16 field, vram column 0 and 29 are the side walls
+        HOST_CHECK((player.x[id] >> 8) >= TILE_WIDTH - 4, id);
+        HOST_CHECK((player.x[id] >> 8) <= (FIELD_WIDTH * TILE_WIDTH) + 3, id);
+        HOST_CHECK((player.y[id] >> 8) <= (FIELD_HEIGHT - 1) * TILE_HEIGHT, id);
+        HOST_CHECK(player.action[id] <= ACTION_RESPAWN, id);
+
+        //only enemies carry gold
+        if (id == SPR_INDEX_PLAYER)
+            continue;
+        HOST_CHECK(player.capturedGoldId[id] >= -1 && player.capturedGoldId[id] < game.goldCount, id);
+        HOST_CHECK(player.lastCapturedGoldId[id] >= -1 && player.lastCapturedGoldId[id] < game.goldCount, id);
+        //enemies are only looked for in a brick by ProcessHoles
+        if (player.action[id] != ACTION_RESPAWN) {
+            HOST_CHECK(GetTileAtFeet(player.x[id] >> 8, player.y[id] >> 8) != TILE_BREAKABLE, id);
+        }
+        if (player.capturedGoldId[id] != -1) {
+            HOST_CHECK(game.gold[player.capturedGoldId[id]].state == GOLD_STATE_CAPTURED, id);
+        }
+    }
+}
+
+void HostRunFrame(uint16_t joypad, HostFrame *frame) {
+    u16 searches = ai.searches;
+    u16 pathHits = ai.pathHits;
+    u16 skipped = ai.skipped;
+
+    hostJoypad = joypad;
+    WaitVsync(1);
+    GameFrame();
+    HostCheckInvariants();
+    HostReadFrame(frame, searches, pathHits, skipped);
+}
+
+uint8_t HostTileAt(uint8_t col, uint8_t row) {
+    return vram[((row * VRAM_TILES_H) + col + 1)];
+}
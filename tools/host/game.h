@@ -0,0 +1,68 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//what the host tools see of the game: start a level, run frames with a
+//joypad state and read back the entities and the per frame counters.
+//Everything is per thread, each thread runs its own game.
+#ifndef HOST_GAME_H
+#define HOST_GAME_H
+
+#include <stdint.h>
+
+#define HOST_ENTITIES       6       //enemies first, the player is the last one
+#define HOST_PLAYER         (HOST_ENTITIES - 1)
+#define HOST_FIELD_WIDTH    28
+#define HOST_FIELD_HEIGHT   16
+
+#define HOST_PLAYING        0
+#define HOST_DIED           1
+#define HOST_COMPLETE       2
+
+typedef struct HostEntity {
+    uint8_t x;              //pixels, column 1 of vram is x = 8
+    uint8_t y;
+    uint8_t action;         //ACTION_*
+    int8_t dir;
+    bool active;
+} HostEntity;
+
+typedef struct HostFrame {
+    uint8_t result;         //HOST_*
+    uint8_t stuckEnemies;   //enemies waiting out a stuck delay
+    uint16_t searches;      //findPath scans during the frame
+    uint16_t pathHits;      //findPath calls answered by the path cache
+    uint16_t skipped;       //enemy plans skipped, the enemy could not act on them
+    uint8_t goldLeft;
+    HostEntity entity[HOST_ENTITIES];
+} HostFrame;
+
+//thrown by the frame that broke an invariant of the game state
+typedef struct HostFailure {
+    const char *what;       //the condition that does not hold
+    const char *file;
+    int line;
+    long value;
+} HostFailure;
+
+int HostLevelCount();
+void HostStartLevel(int level, uint32_t seed, HostFrame *frame);
+void HostRunFrame(uint16_t joypad, HostFrame *frame);     //throws HostFailure
+uint8_t HostTileAt(uint8_t col, uint8_t row);  //vram tile, field coordinates
+
+#endif
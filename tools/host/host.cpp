@@ -0,0 +1,123 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//host implementation of the SDK calls used by the cpu code units
+#include <uzebox.h>
+#include <retronitus.h>
+#include <propeller.h>
+
+#include "game.h"
+
+thread_local HostVram vram;
+thread_local SpriteStruct sprites[MAX_SPRITES];
+thread_local u16 hostJoypad;
+thread_local u32 hostFrame;
+thread_local u8 hostEeprom[EEPROM_SIZE];
+
+void HostCheckFailed(const char *what, const char *file, int line, long value) {
+    HostFailure failure = { what, file, line, value };
+    throw failure;
+}
+
+void Initialize() {
+}
+
+void SetTileTable(const char *table) {
+}
+
+void SetSpritesTileTable(const char *table) {
+}
+
+void SetFontTilesIndex(int index) {
+}
+
+void ClearVram() {
+    memset(vram.tiles, 0, sizeof(vram.tiles));
+}
+
+void WaitVsync(int count) {
+    hostFrame += count;
+}
+
+uint32_t HostCnt() {
+    return hostFrame * (CLKFREQ / 60);
+}
+
+unsigned int ReadJoypad(int joypad) {
+    return joypad == 0 ? hostJoypad : 0;
+}
+
+void SetTile(int x, int y, unsigned int tile) {
+    vram[(y * VRAM_TILES_H) + x] = tile;
+}
+
+void Fill(int x, int y, int width, int height, unsigned int tile) {
+    for (int row = y; row < y + height && row < VRAM_TILES_V; row++) {
+        for (int col = x; col < x + width && col < VRAM_TILES_H; col++) {
+            vram[(row * VRAM_TILES_H) + col] = tile;
+        }
+    }
+}
+
+void DrawMap2(int x, int y, const char *map) {
+    u8 width = map[0];
+    u8 height = map[1];
+
+    for (u8 row = 0; row < height; row++) {
+        for (u8 col = 0; col < width; col++) {
+            SetTile(x + col, y + row, (u8)map[2 + (row * width) + col]);
+        }
+    }
+}
+
+void Print(int x, int y, const char *text) {
+}
+
+void FadeIn(int speed, bool blocking) {
+}
+
+void FadeOut(int speed, bool blocking) {
+}
+
+void hs_tx(int count, void *data, int mailbox, int address) {
+}
+
+void eeprom_read(uintptr_t address, uint8_t *data, int count) {
+    if (address < EEPROM_SIZE) {
+        memcpy(data, &hostEeprom[address], count);
+    } else {
+        memcpy(data, (const void *)address, count);
+    }
+}
+
+void eeprom_write(uintptr_t address, uint8_t *data, int count) {
+    if (address < EEPROM_SIZE) {
+        memcpy(&hostEeprom[address], data, count);
+    }
+}
+
+void sram_read(uintptr_t address, uint8_t *data, int count) {
+    eeprom_read(address, data, count);
+}
+
+void retronitus_start() {
+}
+
+void retronitus_play_soundfx(int channel, uint32_t *patch) {
+}
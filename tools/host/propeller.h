@@ -0,0 +1,33 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//host stand-in for the propgcc header, the system counter of the scheduler:
+//CNT runs at CLKFREQ on a 60 Hz frame clock, a vsync waited is a whole frame
+//so the host counts exactly one vsync per WaitVsync(1) and never waits
+#ifndef HOST_PROPELLER_H
+#define HOST_PROPELLER_H
+
+#include <stdint.h>
+
+#define CLKFREQ             80000000
+#define CNT                 HostCnt()
+
+uint32_t HostCnt();
+
+#endif
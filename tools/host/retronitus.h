@@ -0,0 +1,40 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//host stand-in for the retronitus sound driver, the patches only need the
+//command names to build
+#ifndef HOST_RETRONITUS_H
+#define HOST_RETRONITUS_H
+
+#include <stdint.h>
+
+#define SET                 0x00000001
+#define MODIFY              0x00000002
+#define JUMP                0x00000004
+#define MODULATION          0x00000010
+#define VOLUME              0x00000020
+#define ENVELOPE            0x00000040
+#define FREQUENCY           0x00000080
+#define STEPS               0x00000100
+#define REP(n)              ((n) << 16)
+
+void retronitus_start();
+void retronitus_play_soundfx(int channel, uint32_t *patch);
+
+#endif
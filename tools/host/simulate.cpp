@@ -0,0 +1,431 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Batch simulator, plays every level with many seeds and player policies
+ *  on all the host cores and reports how the levels and the enemy AI fare.
+ *
+ *      p8xgen -o build src/Princesse.p8x
+ *      g++ -O2 -std=gnu++11 -funsigned-char -Wno-narrowing -pthread -Itools/host -Ibuild \
+ *          -o simulate tools/host/simulate.cpp tools/host/game.cpp tools/host/host.cpp
+ *      simulate [-l first[-last]] [-n seeds] [-s seed] [-p policy[,policy]...] [-f frames] [-j threads]
+ *
+ *  Levels are numbered from 1 as on screen. Policies are idle (no input),
+ *  random (random directions and digs) and dig (random walk, digs when an
+ *  enemy comes along the same row). A run ends when the player dies, the
+ *  level is complete or after -f frames (default 3600, one minute).
+ *
+ *  For each level and policy the report gives deaths, completions, runs
+ *  stopped by a broken invariant (see game.h), mean frames to death, enemy
+ *  frames spent stuck, path searches scanning the world and answered by the
+ *  path cache per frame and plans skipped per frame for enemies that could
+ *  not act on them (falling, in a hole, respawning), followed by the first
+ *  failures and a histogram of the host time taken by a frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+
+#define BTN_UP              16
+#define BTN_DOWN            32
+#define BTN_LEFT            64
+#define BTN_RIGHT           128
+#define BTN_A               256
+
+#define POLICY_IDLE         0
+#define POLICY_RANDOM       1
+#define POLICY_DIG          2
+#define POLICY_COUNT        3
+
+#define COST_BUCKETS        24      //power of 2 nanoseconds
+
+static const char *policyNames[POLICY_COUNT] = { "idle", "random", "dig" };
+
+typedef struct Job {
+    int level;
+    int policy;
+    uint32_t seed;
+} Job;
+
+typedef struct Stats {
+    uint64_t runs;
+    uint64_t deaths;
+    uint64_t completions;
+    uint64_t failures;              //runs stopped by a broken invariant
+    uint64_t deathFrames;           //sum of the frames to death
+    uint64_t frames;
+    uint64_t stuckFrames;           //enemy frames spent stuck
+    uint64_t searches;
+    uint32_t maxSearches;           //in a single frame
+    uint64_t pathHits;
+    uint64_t skipped;
+} Stats;
+
+//jobs of one worker, the owner takes from the back and thieves from the front
+typedef struct WorkQueue {
+    std::mutex lock;
+    std::deque<Job> jobs;
+} WorkQueue;
+
+typedef struct Worker {
+    std::vector<Stats> stats;       //level * POLICY_COUNT + policy
+    uint64_t cost[COST_BUCKETS];
+    std::vector<std::string> failures;
+} Worker;
+
+static int firstLevel = 0;
+static int lastLevel = -1;
+static int seeds = 100;
+static uint32_t seedBase = 1;
+static int maxFrames = 3600;
+static bool policyEnabled[POLICY_COUNT];
+
+static std::vector<WorkQueue *> queues;
+
+static bool TakeJob(size_t self, Job *job) {
+    WorkQueue *own = queues[self];
+
+    {
+        std::lock_guard<std::mutex> guard(own->lock);
+        if (!own->jobs.empty()) {
+            *job = own->jobs.back();
+            own->jobs.pop_back();
+            return true;
+        }
+    }
+
+    //steal the oldest job of the next busy worker, no job is ever added
+    //once the workers run so finding all queues empty means we are done
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkQueue *victim = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->jobs.empty()) {
+            *job = victim->jobs.front();
+            victim->jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t NextRandom(uint32_t *state) {
+    //xorshift32
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint16_t RandomDirection(uint32_t *state) {
+    static const uint16_t directions[] = { 0, BTN_LEFT, BTN_RIGHT, BTN_UP, BTN_DOWN, BTN_LEFT, BTN_RIGHT };
+    return directions[NextRandom(state) % (sizeof(directions) / sizeof(directions[0]))];
+}
+
+//joypad state for the next frame
+static uint16_t Play(int policy, const HostFrame *frame, uint32_t *state, uint16_t *held, int *holdFrames) {
+    const HostEntity *me = &frame->entity[HOST_PLAYER];
+
+    switch (policy) {
+        case POLICY_RANDOM:
+            if (--*holdFrames <= 0) {
+                *held = RandomDirection(state);
+                if ((NextRandom(state) & 15) == 0) {
+                    *held |= BTN_A;
+                }
+                *holdFrames = 8 + (NextRandom(state) % 32);
+            }
+            return *held;
+
+        case POLICY_DIG:
+            for (int id = 0; id < HOST_PLAYER; id++) {
+                const HostEntity *enemy = &frame->entity[id];
+                int dx = enemy->x - me->x;
+
+                if (enemy->active && enemy->y == me->y && dx * me->dir > 0 && dx * me->dir < 4 * 8) {
+                    return BTN_A;
+                }
+            }
+            if (--*holdFrames <= 0) {
+                *held = RandomDirection(state);
+                *holdFrames = 8 + (NextRandom(state) % 32);
+            }
+            return *held;
+    }
+
+    return 0;
+}
+
+static void Run(const Job *job, Worker *worker) {
+    Stats *stats = &worker->stats[(job->level * POLICY_COUNT) + job->policy];
+    HostFrame frame;
+    uint32_t state = (job->seed * 2654435761u) | 1;
+    uint16_t held = 0;
+    int holdFrames = 0;
+    int frames;
+
+    HostStartLevel(job->level, job->seed, &frame);
+
+    for (frames = 0; frames < maxFrames && frame.result == HOST_PLAYING; frames++) {
+        uint16_t joypad = Play(job->policy, &frame, &state, &held, &holdFrames);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        try {
+            HostRunFrame(joypad, &frame);
+        } catch (const HostFailure &failure) {
+            char text[256];
+
+            snprintf(text, sizeof(text), "level %d %s seed %u frame %d: %s:%d %s (%ld)", job->level + 1,
+                policyNames[job->policy], job->seed, frames, failure.file, failure.line, failure.what, failure.value);
+            worker->failures.push_back(text);
+            stats->runs++;
+            stats->failures++;
+            stats->frames += frames;
+            return;
+        }
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        int bucket = 0;
+        while (ns > 1 && bucket < COST_BUCKETS - 1) {
+            ns >>= 1;
+            bucket++;
+        }
+        worker->cost[bucket]++;
+
+        stats->stuckFrames += frame.stuckEnemies;
+        stats->searches += frame.searches;
+        stats->pathHits += frame.pathHits;
+        stats->skipped += frame.skipped;
+        if (frame.searches > stats->maxSearches) {
+            stats->maxSearches = frame.searches;
+        }
+    }
+
+    stats->runs++;
+    stats->frames += frames;
+    if (frame.result == HOST_DIED) {
+        stats->deaths++;
+        stats->deathFrames += frames;
+    } else if (frame.result == HOST_COMPLETE) {
+        stats->completions++;
+    }
+}
+
+static void Work(size_t self, Worker *worker) {
+    Job job;
+
+    while (TakeJob(self, &job)) {
+        Run(&job, worker);
+    }
+}
+
+static void Usage() {
+    fprintf(stderr, "usage: simulate [-l first[-last]] [-n seeds] [-s seed] [-p policy[,policy]...] [-f frames] [-j threads]\n");
+    exit(2);
+}
+
+static void ParsePolicies(const char *list) {
+    std::string names(list);
+    size_t begin = 0;
+
+    memset(policyEnabled, 0, sizeof(policyEnabled));
+    while (begin <= names.size()) {
+        size_t end = names.find(',', begin);
+        std::string name = names.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        int p;
+
+        for (p = 0; p < POLICY_COUNT && name != policyNames[p]; p++)
+            ;
+        if (p == POLICY_COUNT) {
+            fprintf(stderr, "simulate: unknown policy '%s'\n", name.c_str());
+            exit(2);
+        }
+        policyEnabled[p] = true;
+
+        if (end == std::string::npos)
+            break;
+        begin = end + 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int threads = std::thread::hardware_concurrency();
+
+    for (int p = 0; p < POLICY_COUNT; p++) {
+        policyEnabled[p] = true;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || argv[i][2] != 0) {
+            Usage();
+        }
+        const char *arg = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'l':
+                if (sscanf(arg, "%d-%d", &firstLevel, &lastLevel) == 1) {
+                    lastLevel = firstLevel;
+                }
+                firstLevel--;
+                lastLevel--;
+                break;
+            case 'n':
+                seeds = atoi(arg);
+                break;
+            case 's':
+                seedBase = strtoul(arg, NULL, 0);
+                break;
+            case 'p':
+                ParsePolicies(arg);
+                break;
+            case 'f':
+                maxFrames = atoi(arg);
+                break;
+            case 'j':
+                threads = atoi(arg);
+                break;
+            default:
+                Usage();
+        }
+    }
+
+    if (lastLevel < 0 || lastLevel >= HostLevelCount()) {
+        lastLevel = HostLevelCount() - 1;
+    }
+    if (firstLevel < 0 || firstLevel > lastLevel || seeds <= 0 || maxFrames <= 0) {
+        Usage();
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+
+    //deal the jobs round robin, levels differ a lot in cost and stealing
+    //evens out what is left at the end
+    for (int i = 0; i < threads; i++) {
+        queues.push_back(new WorkQueue);
+    }
+    size_t next = 0;
+    for (int level = firstLevel; level <= lastLevel; level++) {
+        for (int p = 0; p < POLICY_COUNT; p++) {
+            if (!policyEnabled[p])
+                continue;
+            for (int s = 0; s < seeds; s++) {
+                Job job = { level, p, seedBase + s };
+                queues[next++ % threads]->jobs.push_back(job);
+            }
+        }
+    }
+
+    std::vector<Worker> workers(threads);
+    std::vector<std::thread> pool;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].stats.assign(HostLevelCount() * POLICY_COUNT, Stats());
+        memset(workers[i].cost, 0, sizeof(workers[i].cost));
+        pool.push_back(std::thread(Work, i, &workers[i]));
+    }
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+    //only once all have stopped, a thief may look at any queue
+    for (size_t i = 0; i < queues.size(); i++) {
+        delete queues[i];
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    //merge the workers
+    std::vector<Stats> total(HostLevelCount() * POLICY_COUNT, Stats());
+    uint64_t cost[COST_BUCKETS] = { 0 };
+    uint64_t frames = 0;
+
+    for (int i = 0; i < threads; i++) {
+        for (size_t j = 0; j < total.size(); j++) {
+            Stats *to = &total[j];
+            const Stats *from = &workers[i].stats[j];
+
+            to->runs += from->runs;
+            to->deaths += from->deaths;
+            to->completions += from->completions;
+            to->failures += from->failures;
+            to->deathFrames += from->deathFrames;
+            to->frames += from->frames;
+            to->stuckFrames += from->stuckFrames;
+            to->searches += from->searches;
+            to->pathHits += from->pathHits;
+            to->skipped += from->skipped;
+            if (from->maxSearches > to->maxSearches) {
+                to->maxSearches = from->maxSearches;
+            }
+        }
+        for (int b = 0; b < COST_BUCKETS; b++) {
+            cost[b] += workers[i].cost[b];
+        }
+    }
+
+    printf("level policy    runs  deaths  complete  failed  frames/death  stuck/frame  searches/frame  max  cached/frame  skipped/frame\n");
+    for (int level = firstLevel; level <= lastLevel; level++) {
+        for (int p = 0; p < POLICY_COUNT; p++) {
+            const Stats *s = &total[(level * POLICY_COUNT) + p];
+
+            if (s->runs == 0)
+                continue;
+            frames += s->frames;
+            printf("%5d %-7s %6llu %7llu %9llu %7llu %13.0f %12.3f %15.2f %4u %13.2f %14.2f\n", level + 1, policyNames[p],
+                (unsigned long long) s->runs, (unsigned long long) s->deaths, (unsigned long long) s->completions,
+                (unsigned long long) s->failures,
+                s->deaths ? (double) s->deathFrames / s->deaths : 0.0,
+                s->frames ? (double) s->stuckFrames / s->frames : 0.0,
+                s->frames ? (double) s->searches / s->frames : 0.0,
+                s->maxSearches,
+                s->frames ? (double) s->pathHits / s->frames : 0.0,
+                s->frames ? (double) s->skipped / s->frames : 0.0);
+        }
+    }
+
+    printf("\nframe cost     frames\n");
+    for (int b = 0; b < COST_BUCKETS; b++) {
+        if (cost[b] != 0) {
+            printf("< %8llu ns %10llu\n", 1ULL << (b + 1), (unsigned long long) cost[b]);
+        }
+    }
+
+    //the first few broken invariants, fuzz reproduces them
+    int shown = 0;
+    for (int i = 0; i < threads; i++) {
+        for (size_t j = 0; j < workers[i].failures.size() && shown < 10; j++, shown++) {
+            printf("%s%s\n", shown == 0 ? "\nfailures\n" : "", workers[i].failures[j].c_str());
+        }
+    }
+
+    printf("\n%llu frames in %.1f s on %d threads, %.0f frames/s\n", (unsigned long long) frames, seconds, threads,
+        seconds > 0 ? frames / seconds : 0.0);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//host stand-in for the P8X SDK header, enough to run the cpu code units
+//headless: vram and sprites are per thread arrays, calls that only matter
+//on screen or on the speaker do nothing and the joypad is set by the tool.
+//Tile names and build flags come from p8xgen, run it on the project first.
+#ifndef HOST_UZEBOX_H
+#define HOST_UZEBOX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Princesse_defines.h"
+#include "Princesse_tiles.h"
+
+typedef uint8_t u8;
+typedef int8_t s8;
+typedef uint16_t u16;
+typedef int16_t s16;
+typedef uint32_t u32;
+typedef int32_t s32;
+
+#define PROGMEM
+
+#define TILE_WIDTH          8
+#define SCREEN_TILES_H      30
+#define SCREEN_TILES_V      (FRAME_LINES / TILE_HEIGHT)
+#define VRAM_TILES_H        30
+#define VRAM_TILES_V        (SCREEN_TILES_V + 1)    //the pause menu rolls in from below
+#define MAX_SPRITES         P8X_SPRITES
+#define SPRITE_FLIP_X       1
+
+#define BTN_B               1
+#define BTN_Y               2
+#define BTN_SELECT          4
+#define BTN_START           8
+#define BTN_UP              16
+#define BTN_DOWN            32
+#define BTN_LEFT            64
+#define BTN_RIGHT           128
+#define BTN_A               256
+#define BTN_X               512
+#define BTN_SL              1024
+#define BTN_SR              2048
+
+//EEPROM offsets below EEPROM_SIZE are the save block, anything else is the
+//address of data linked in the upper EEPROM (levels)
+#define EEPROM_SIZE         32768
+#define HIGH_EEPROM_OFFSET(p)   ((uintptr_t)(p))
+
+#define GPU_TILES_RAM       0x4000
+#define GPU_MAILBOX         0x7f00
+
+typedef struct SpriteStruct {
+    u8 x;
+    u8 y;
+    u8 tileIndex;
+    u8 flags;
+} SpriteStruct;
+
+void HostCheckFailed(const char *what, const char *file, int line, long value);
+
+//vram indexing is bounds checked on the host
+typedef struct HostVram {
+    u8 tiles[VRAM_TILES_H * VRAM_TILES_V];
+
+    u8 &operator[](int i) {
+        if (i < 0 || i >= VRAM_TILES_H * VRAM_TILES_V) {
+            HostCheckFailed("vram index in bounds", __FILE__, __LINE__, i);
+        }
+        return tiles[i];
+    }
+} HostVram;
+
+extern thread_local HostVram vram;
+extern thread_local SpriteStruct sprites[MAX_SPRITES];
+extern thread_local u16 hostJoypad;     //what ReadJoypad returns
+extern thread_local u32 hostFrame;      //vsyncs waited
+
+void Initialize();
+void SetTileTable(const char *table);
+void SetSpritesTileTable(const char *table);
+void SetFontTilesIndex(int index);
+void ClearVram();
+void WaitVsync(int count);
+unsigned int ReadJoypad(int joypad);
+void SetTile(int x, int y, unsigned int tile);
+void Fill(int x, int y, int width, int height, unsigned int tile);
+void DrawMap2(int x, int y, const char *map);
+void Print(int x, int y, const char *text);
+void FadeIn(int speed, bool blocking);
+void FadeOut(int speed, bool blocking);
+void hs_tx(int count, void *data, int mailbox, int address);
+void eeprom_read(uintptr_t address, uint8_t *data, int count);
+void eeprom_write(uintptr_t address, uint8_t *data, int count);
+void sram_read(uintptr_t address, uint8_t *data, int count);
+
+#endif
@@ -0,0 +1,818 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Host side generator for .p8x projects.
+ *
+ *  Reads the project file written by the P8X IDE and emits the same names
+ *  the IDE gives to the game code, so host builds and tools do not need
+ *  their own copy of the tileset or of the build settings.
+ *
+ *      g++ -O2 -o p8xgen p8xgen.cpp
+ *      p8xgen [-o dir] [-d] [-k tile[+count]]... [-w packed.p8x] [-f main.cpp] Princesse.p8x
+ *
+ *  -d removes the tiles that are exact copies of another one, their names
+ *  are mapped to the copy that is kept and the following tiles move down.
+ *  Tile 0 (ClearVram) and members of a <group>_NN run (font, sprites),
+ *  addressed from the group base, are never removed. -k marks the RAM
+ *  tiles rewritten at run time (-k T17+8), they are left out entirely. Mirrored copies are reported only,
+ *  background tiles have no flip attribute and sprite frames are in groups.
+ *  -w writes the project with the duplicates removed, to be built in place
+ *  of the original so the GPU tile RAM and the upload shrink as well.
+ *
+ *  -f rewrites the tileFlags table of main.cpp, between the tile flags
+ *  markers, with the TILE_FLAG_* bits of every tile up to the last one that
+ *  has some. The bits come from the flags attribute of the <tile> ("solid
+ *  blocking") or else from the first of tileRules matching the tile name.
+ *
+ *  Output, named after the project, goes to the -o directory (created if
+ *  missing, the current one by default):
+ *
+ *      <name>_defines.h     CFLAGS defines and project attributes
+ *      <name>_tiles.h       tile indices (TILE_BG, T41, SPRITES_00...), the first
+ *                           tile of a group (<group>_00) also gets <GROUP>_00_OFS,
+ *                           its address in the GPU tile RAM
+ *      <name>_tiledata.h    tile pixels, one 64 bit word per row as in the project
+ *      <name>_prototypes.h  prototypes of the cpu code units, as the IDE adds them
+ *      <name>.manifest      memory model, flags and code units, one key=value per line
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+typedef struct Element {
+    std::string name;
+    std::map<std::string, std::string> attrs;
+    std::string text;
+    std::vector<Element> children;
+    int line;
+    size_t begin;           //offset of the opening tag
+    size_t end;             //offset past the closing tag
+} Element;
+
+typedef struct Tile {
+    std::string name;       //as in the project
+    std::string define;     //uppercase name used by the game code
+    int index;
+    int width;
+    int height;
+    std::vector<unsigned long long> rows;
+    size_t begin;
+    size_t end;
+    std::string flags;      //TILE_FLAG_* expression, "0" if none
+    bool pinned;            //must keep its index relative to the other tiles
+    bool ramTile;           //pixels changed at run time
+    int twin;               //tile with the same pixels that is kept, -1 if none
+    int mirror;             //tile with the mirrored pixels, -1 if none
+    int packed;             //index after deduplication
+} Tile;
+
+//flags of the tiles without a flags attribute, the name must match in full
+typedef struct TileRule {
+    const char *name;
+    const char *flags;
+} TileRule;
+
+static const TileRule tileRules[] = {
+    { "TILE_BG|TILE_SHADOW",                "background" },
+    { "TILE_BREAKABLE",                     "solid blocking deadly" },
+    { "TILE_UNBREAKABLE|TILE_BG_STEP_ON",   "solid blocking" },
+    { "TILE_LADDER",                        "solid ladder" },
+    { "TILE_ROPE",                          "rope" },
+    { "TILE_GOLD[0-9]+",                    "gold" },
+    { "TILE_DESTROY[0-9]+|TILE_BG_HOLE",    "hole" },
+};
+
+static const char *tileFlagNames[] = {
+    "solid", "blocking", "ladder", "rope", "gold", "hole", "background", "deadly"
+};
+
+#define FLAGS_BEGIN_MARKER  "//tile flags, generated from "
+#define FLAGS_END_MARKER    "//end of tile flags"
+
+static const char *fileName;
+static int errors;
+
+static void error(int line, const char *msg, const std::string &arg = "") {
+    fprintf(stderr, "%s:%d: %s%s\n", fileName, line, msg, arg.c_str());
+    errors++;
+}
+
+static bool readFile(const std::string &path, std::string &text) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        perror(path.c_str());
+        return false;
+    }
+
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        text.append(buf, n);
+    }
+    fclose(fp);
+
+    return true;
+}
+
+//minimal XML reader, the IDE writes only elements, attributes and text
+static bool parse(const std::string &text, Element &root) {
+    std::vector<Element *> stack;
+    size_t pos = 0;
+    int line = 1;
+
+    root.name = "";
+    stack.push_back(&root);
+
+    while (pos < text.size()) {
+        size_t lt = text.find('<', pos);
+        if (lt == std::string::npos)
+            lt = text.size();
+        for (size_t i = pos; i < lt; i++) {
+            if (text[i] == '\n')
+                line++;
+        }
+        stack.back()->text.append(text, pos, lt - pos);
+        if (lt == text.size())
+            break;
+
+        size_t gt = text.find('>', lt);
+        if (gt == std::string::npos) {
+            error(line, "unterminated tag");
+            return false;
+        }
+        std::string tag = text.substr(lt + 1, gt - lt - 1);
+        pos = gt + 1;
+
+        if (tag[0] == '?' || tag[0] == '!') {
+            if (tag.compare(0, 3, "!--") == 0) {
+                size_t end = text.find("-->", lt);
+                pos = (end == std::string::npos) ? text.size() : end + 3;
+            }
+        } else if (tag[0] == '/') {
+            std::string name = tag.substr(1);
+            while (!name.empty() && isspace((unsigned char) name[name.size() - 1]))
+                name.erase(name.size() - 1);
+            if (stack.size() < 2 || stack.back()->name != name) {
+                error(line, "unexpected closing tag ", name);
+                return false;
+            }
+            stack.back()->end = pos;
+            stack.pop_back();
+        } else {
+            bool empty = tag[tag.size() - 1] == '/';
+            if (empty)
+                tag.erase(tag.size() - 1);
+
+            Element e;
+            size_t i = 0;
+            while (i < tag.size() && !isspace((unsigned char) tag[i]))
+                i++;
+            e.name = tag.substr(0, i);
+            e.line = line;
+            e.begin = lt;
+            e.end = pos;
+
+            //name="value" pairs
+            while (i < tag.size()) {
+                while (i < tag.size() && isspace((unsigned char) tag[i]))
+                    i++;
+                size_t eq = tag.find('=', i);
+                if (i >= tag.size() || eq == std::string::npos)
+                    break;
+                size_t q1 = tag.find('"', eq), q2 = (q1 == std::string::npos) ? q1 : tag.find('"', q1 + 1);
+                if (q2 == std::string::npos) {
+                    error(line, "malformed attribute in ", e.name);
+                    return false;
+                }
+                std::string key = tag.substr(i, eq - i);
+                while (!key.empty() && isspace((unsigned char) key[key.size() - 1]))
+                    key.erase(key.size() - 1);
+                e.attrs[key] = tag.substr(q1 + 1, q2 - q1 - 1);
+                i = q2 + 1;
+            }
+            for (size_t j = lt; j < gt; j++) {
+                if (text[j] == '\n')
+                    line++;
+            }
+
+            stack.back()->children.push_back(e);
+            if (!empty)
+                stack.push_back(&stack.back()->children.back());
+        }
+    }
+
+    if (stack.size() != 1) {
+        error(line, "missing closing tag for ", stack.back()->name);
+        return false;
+    }
+
+    return true;
+}
+
+static const Element *child(const Element &e, const char *name) {
+    for (size_t i = 0; i < e.children.size(); i++) {
+        if (e.children[i].name == name)
+            return &e.children[i];
+    }
+    return NULL;
+}
+
+static std::string attr(const Element &e, const char *name) {
+    std::map<std::string, std::string>::const_iterator it = e.attrs.find(name);
+    return it == e.attrs.end() ? "" : it->second;
+}
+
+static std::string upper(std::string s) {
+    for (size_t i = 0; i < s.size(); i++) {
+        s[i] = toupper((unsigned char) s[i]);
+    }
+    return s;
+}
+
+//"solid blocking" to TILE_FLAG_SOLID|TILE_FLAG_BLOCKING, from the attribute
+//or else from tileRules
+static std::string tileFlags(std::string words, const std::string &define, int line) {
+    std::string flags;
+
+    if (words.empty()) {
+        for (size_t i = 0; i < sizeof(tileRules) / sizeof(tileRules[0]); i++) {
+            if (std::regex_match(define, std::regex(tileRules[i].name))) {
+                words = tileRules[i].flags;
+                break;
+            }
+        }
+    }
+
+    const char *p = words.c_str();
+    while (*p != '\0') {
+        while (isspace((unsigned char) *p) || *p == ',')
+            p++;
+        const char *start = p;
+        while (*p != '\0' && !isspace((unsigned char) *p) && *p != ',')
+            p++;
+        if (p == start)
+            break;
+
+        std::string word(start, p - start);
+        size_t i;
+        for (i = 0; i < sizeof(tileFlagNames) / sizeof(tileFlagNames[0]); i++) {
+            if (word == tileFlagNames[i])
+                break;
+        }
+        if (i == sizeof(tileFlagNames) / sizeof(tileFlagNames[0])) {
+            error(line, "unknown tile flag ", word);
+            continue;
+        }
+        flags += (flags.empty() ? "TILE_FLAG_" : "|TILE_FLAG_") + upper(word);
+    }
+
+    return flags.empty() ? "0" : flags;
+}
+
+static std::vector<Tile> readTiles(const Element &tileset) {
+    std::vector<Tile> tiles;
+    std::map<std::string, int> names;
+
+    for (size_t i = 0; i < tileset.children.size(); i++) {
+        const Element &e = tileset.children[i];
+        if (e.name != "tile")
+            continue;
+
+        Tile t;
+        t.name = attr(e, "name");
+        t.define = upper(t.name);
+        t.index = atoi(attr(e, "index").c_str());
+        t.width = atoi(attr(e, "width").c_str());
+        t.height = atoi(attr(e, "height").c_str());
+        t.begin = e.begin;
+        t.end = e.end;
+        t.pinned = (t.index == 0);
+        t.ramTile = false;
+        t.twin = -1;
+        t.mirror = -1;
+        t.packed = t.index;
+        t.flags = tileFlags(attr(e, "flags"), t.define, e.line);
+
+        if (t.index != (int) tiles.size())
+            error(e.line, "tile out of sequence: ", t.name);
+        if (t.width != 8)
+            error(e.line, "only 8 pixels wide tiles are supported: ", t.name);
+        if (names.find(t.define) != names.end())
+            error(e.line, "duplicate tile name ", t.name);
+        names[t.define] = t.index;
+
+        //rows are 0x... words separated by commas, the trailing comma is optional
+        const char *p = e.text.c_str();
+        while (*p != '\0') {
+            if (isspace((unsigned char) *p) || *p == ',') {
+                p++;
+                continue;
+            }
+            char *end;
+            unsigned long long row = strtoull(p, &end, 16);
+            if (end == p) {
+                error(e.line, "bad pixel data in ", t.name);
+                break;
+            }
+            t.rows.push_back(row);
+            p = end;
+        }
+        if ((int) t.rows.size() != t.height)
+            error(e.line, "row count does not match the tile height: ", t.name);
+
+        tiles.push_back(t);
+    }
+
+    return tiles;
+}
+
+static unsigned long long mirrorRow(unsigned long long row) {
+    unsigned long long m = 0;
+    for (int i = 0; i < 8; i++) {
+        m = (m << 8) | ((row >> (i * 8)) & 0xff);
+    }
+    return m;
+}
+
+//returns the number of tiles removed
+static int dedupTiles(std::vector<Tile> &tiles, const std::vector<std::string> &keep) {
+    std::map<std::string, int> index;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        index[tiles[i].define] = i;
+    }
+
+    //<group>_NN tiles, when <group>_00 exists
+    for (size_t i = 0; i < tiles.size(); i++) {
+        const std::string &d = tiles[i].define;
+        size_t u = d.rfind('_');
+        if (u != std::string::npos && d.size() - u == 3 && isxdigit((unsigned char) d[u + 1]) && isxdigit((unsigned char) d[u + 2])
+            && index.find(d.substr(0, u) + "_00") != index.end()) {
+            tiles[i].pinned = true;
+        }
+    }
+
+    for (size_t i = 0; i < keep.size(); i++) {
+        size_t plus = keep[i].find('+');
+        std::string first = upper(keep[i].substr(0, plus));
+        int count = (plus == std::string::npos) ? 1 : atoi(keep[i].c_str() + plus + 1);
+        std::map<std::string, int>::iterator it = index.find(first);
+        if (it == index.end() || count <= 0 || it->second + count > (int) tiles.size()) {
+            error(0, "bad -k range ", keep[i]);
+            continue;
+        }
+        for (int j = 0; j < count; j++) {
+            tiles[it->second + j].ramTile = true;
+        }
+    }
+
+    //the kept tile of each set of copies is the first pinned one, or the first one
+    std::map<std::vector<unsigned long long>, int> kept;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].ramTile)
+            continue;
+        std::map<std::vector<unsigned long long>, int>::iterator it = kept.find(tiles[i].rows);
+        if (it == kept.end()) {
+            kept[tiles[i].rows] = i;
+        } else if (tiles[i].pinned && !tiles[it->second].pinned) {
+            it->second = i;
+        }
+    }
+
+    int removed = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].ramTile)
+            continue;
+        int k = kept[tiles[i].rows];
+        if (k != (int) i && !tiles[i].pinned) {
+            tiles[i].twin = k;
+            removed++;
+        }
+
+        std::vector<unsigned long long> m(tiles[i].rows.size());
+        for (size_t j = 0; j < m.size(); j++) {
+            m[j] = mirrorRow(tiles[i].rows[j]);
+        }
+        std::map<std::vector<unsigned long long>, int>::iterator it = kept.find(m);
+        if (m != tiles[i].rows && it != kept.end())
+            tiles[i].mirror = it->second;
+    }
+
+    int packed = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].twin == -1)
+            tiles[i].packed = packed++;
+    }
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].twin != -1)
+            tiles[i].packed = tiles[tiles[i].twin].packed;
+    }
+
+    return removed;
+}
+
+//the project text without the removed tiles and with the new indices
+static std::string packProject(const std::string &text, const std::vector<Tile> &tiles) {
+    std::string out;
+    size_t pos = 0;
+
+    for (size_t i = 0; i < tiles.size(); i++) {
+        const Tile &t = tiles[i];
+        if (t.twin != -1) {
+            //whole lines, indentation and line break included
+            size_t begin = t.begin, end = t.end;
+            while (begin > pos && (text[begin - 1] == ' ' || text[begin - 1] == '\t'))
+                begin--;
+            if (end < text.size() && text[end] == '\r')
+                end++;
+            if (end < text.size() && text[end] == '\n')
+                end++;
+            out.append(text, pos, begin - pos);
+            pos = end;
+            continue;
+        }
+
+        size_t tagEnd = text.find('>', t.begin);
+        size_t attr = text.find(" index=\"", t.begin);
+        if (attr != std::string::npos && attr < tagEnd) {
+            size_t value = attr + 8, close = text.find('"', value);
+            out.append(text, pos, value - pos);
+            out += std::to_string(t.packed);
+            pos = close;
+        }
+    }
+    out.append(text, pos, std::string::npos);
+
+    return out;
+}
+
+//function definitions at file scope, the IDE puts their prototypes in front of the code
+static std::vector<std::string> readPrototypes(const std::string &path) {
+    static const std::regex definition("^([A-Za-z_][\\w \\t\\*]*?[ \\t\\*])(\\w+)[ \\t]*\\(([^;{}]*)\\)[ \\t]*\\{?[ \\t\\r]*$");
+    std::vector<std::string> prototypes;
+    std::string text;
+
+    if (!readFile(path, text)) {
+        errors++;
+        return prototypes;
+    }
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = text.size();
+        std::string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+
+        std::smatch m;
+        if (!std::regex_match(line, m, definition))
+            continue;
+        std::string type = m[1].str();
+        if (m[2].str() == "main" || type.compare(0, 7, "typedef") == 0 || type.compare(0, 6, "struct") == 0 || type.compare(0, 6, "return") == 0)
+            continue;
+        prototypes.push_back(type + m[2].str() + "(" + m[3].str() + ");");
+    }
+
+    return prototypes;
+}
+
+//creates the output directory and its parents, as mkdir -p
+static bool makeDirs(const std::string &path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/')
+            continue;
+        std::string part = path.substr(0, i);
+        struct stat st;
+        if (stat(part.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            continue;
+        if (mkdir(part.c_str(), 0777) != 0 && errno != EEXIST) {
+            perror(part.c_str());
+            errors++;
+            return false;
+        }
+    }
+    return true;
+}
+
+static FILE *create(const std::string &path, const std::string &guard) {
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        perror(path.c_str());
+        errors++;
+        return NULL;
+    }
+    fprintf(fp, "//generated from %s by tools/p8xgen.cpp, do not edit\n", fileName);
+    if (!guard.empty())
+        fprintf(fp, "#ifndef %s\n#define %s\n\n", guard.c_str(), guard.c_str());
+    return fp;
+}
+
+static void finish(FILE *fp, const std::string &guard) {
+    if (fp == NULL)
+        return;
+    if (!guard.empty())
+        fprintf(fp, "\n#endif\n");
+    fclose(fp);
+}
+
+//replaces the tile flags block of path, indexed as the packed tiles
+static bool writeFlags(const char *path, const std::vector<Tile> &tiles, const std::string &project) {
+    std::string block, rows;
+    int count = 0;
+
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].twin != -1) {
+            if (tiles[i].flags != tiles[tiles[i].twin].flags)
+                fprintf(stderr, "%s: flags differ from %s, its copy\n", tiles[i].name.c_str(), tiles[tiles[i].twin].name.c_str());
+            continue;
+        }
+        if (tiles[i].flags != "0")
+            count = tiles[i].packed + 1;
+    }
+
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (tiles[i].twin != -1 || tiles[i].packed >= count)
+            continue;
+        char line[256];
+        snprintf(line, sizeof(line), "    %-52s //%s\n", (tiles[i].flags + ",").c_str(), tiles[i].name.c_str());
+        rows += line;
+    }
+
+    block = FLAGS_BEGIN_MARKER + project + " by tools/p8xgen.cpp\n";
+    block += "#define TILE_FLAGS_COUNT    " + std::to_string(count) + "\n";
+    block += "const u8 tileFlags[TILE_FLAGS_COUNT] = {\n" + rows + "};\n";
+    block += FLAGS_END_MARKER "\n";
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        text.append(buf, n);
+    }
+    fclose(fp);
+
+    size_t begin = text.find(FLAGS_BEGIN_MARKER);
+    size_t end = text.find(FLAGS_END_MARKER);
+    if (begin == std::string::npos || end == std::string::npos || end < begin) {
+        fprintf(stderr, "%s: generated tile flags block not found\n", path);
+        return false;
+    }
+    end = text.find('\n', end);
+    end = (end == std::string::npos) ? text.size() : end + 1;
+    text.replace(begin, end - begin, block);
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    std::string outDir = ".", packedPath, flagsPath;
+    std::vector<std::string> keep;
+    bool dedup = false;
+    int arg;
+
+    for (arg = 1; arg < argc - 1; arg++) {
+        if (strcmp(argv[arg], "-o") == 0) {
+            outDir = argv[++arg];
+        } else if (strcmp(argv[arg], "-d") == 0) {
+            dedup = true;
+        } else if (strcmp(argv[arg], "-k") == 0) {
+            keep.push_back(argv[++arg]);
+        } else if (strcmp(argv[arg], "-w") == 0) {
+            packedPath = argv[++arg];
+            dedup = true;
+        } else if (strcmp(argv[arg], "-f") == 0) {
+            flagsPath = argv[++arg];
+        } else {
+            break;
+        }
+    }
+    if (arg != argc - 1) {
+        fprintf(stderr, "usage: %s [-o dir] [-d] [-k tile[+count]]... [-w packed.p8x] [-f main.cpp] <project.p8x>\n", argv[0]);
+        return 2;
+    }
+
+    fileName = argv[arg];
+    std::string text;
+    if (!readFile(fileName, text))
+        return 2;
+
+    Element doc;
+    if (!parse(text, doc))
+        return 1;
+    const Element *project = child(doc, "project");
+    if (project == NULL) {
+        error(1, "not a P8X project");
+        return 1;
+    }
+
+    //project name and directory, code units are relative to the project
+    std::string path = fileName, dir, name;
+    size_t slash = path.find_last_of("/\\");
+    dir = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+    name = path.substr(dir.size());
+    if (name.rfind('.') != std::string::npos)
+        name.erase(name.rfind('.'));
+    std::string prefix = outDir + "/" + name;
+    std::string guard = upper(name);
+
+    std::map<std::string, std::string> attributes;
+    std::vector<std::string> gpuUnits, cpuUnits;
+    std::vector<Tile> tiles;
+
+    for (size_t i = 0; i < project->children.size(); i++) {
+        const Element &e = project->children[i];
+        if (e.name == "attribute") {
+            attributes[attr(e, "name")] = attr(e, "value");
+        } else if (e.name == "gpu" || e.name == "cpu") {
+            for (size_t j = 0; j < e.children.size(); j++) {
+                const Element &c = e.children[j];
+                if (c.name == "code") {
+                    (e.name == "gpu" ? gpuUnits : cpuUnits).push_back(attr(c, "file"));
+                } else if (c.name == "tileset") {
+                    tiles = readTiles(c);
+                }
+            }
+        }
+    }
+
+    //-DNAME=value and -DNAME in CFLAGS
+    std::vector<std::pair<std::string, std::string> > defines;
+    const char *p = attributes["CFLAGS"].c_str();
+    while (*p != '\0') {
+        while (isspace((unsigned char) *p))
+            p++;
+        const char *start = p;
+        while (*p != '\0' && !isspace((unsigned char) *p))
+            p++;
+        std::string flag(start, p - start);
+        if (flag.compare(0, 2, "-D") == 0 && flag.size() > 2) {
+            size_t eq = flag.find('=');
+            if (eq == std::string::npos) {
+                defines.push_back(std::make_pair(flag.substr(2), "1"));
+            } else {
+                defines.push_back(std::make_pair(flag.substr(2, eq - 2), flag.substr(eq + 1)));
+            }
+        }
+    }
+
+    if (!tiles.empty()) {
+        for (size_t i = 0; i < defines.size(); i++) {
+            if (defines[i].first == "TILE_HEIGHT" && atoi(defines[i].second.c_str()) != tiles[0].height)
+                error(project->line, "TILE_HEIGHT in CFLAGS does not match the tileset");
+        }
+    }
+
+    std::vector<std::string> prototypes;
+    for (size_t i = 0; i < cpuUnits.size(); i++) {
+        std::vector<std::string> unit = readPrototypes(dir + cpuUnits[i]);
+        prototypes.insert(prototypes.end(), unit.begin(), unit.end());
+    }
+
+    int removed = 0;
+    if (dedup) {
+        removed = dedupTiles(tiles, keep);
+        for (size_t i = 0; i < tiles.size(); i++) {
+            if (tiles[i].twin != -1)
+                fprintf(stderr, "%s: same as %s, removed\n", tiles[i].name.c_str(), tiles[tiles[i].twin].name.c_str());
+            if (tiles[i].mirror != -1 && tiles[i].mirror < (int) i)
+                fprintf(stderr, "%s: mirror of %s, kept\n", tiles[i].name.c_str(), tiles[tiles[i].mirror].name.c_str());
+        }
+        fprintf(stderr, "%d of %d tiles removed, %d bytes saved\n", removed, (int) tiles.size(),
+            tiles.empty() ? 0 : removed * tiles[0].width * tiles[0].height);
+    }
+
+    if (errors != 0 || !makeDirs(outDir))
+        return 1;
+
+    FILE *fp = create(prefix + "_defines.h", guard + "_DEFINES_H");
+    if (fp != NULL) {
+        for (size_t i = 0; i < defines.size(); i++) {
+            fprintf(fp, "#define %-24s %s\n", defines[i].first.c_str(), defines[i].second.c_str());
+        }
+        fprintf(fp, "\n");
+        for (std::map<std::string, std::string>::iterator it = attributes.begin(); it != attributes.end(); it++) {
+            if (it->first != "CFLAGS" && it->first != "memory_model")
+                fprintf(fp, "#define P8X_%-20s %s\n", upper(it->first).c_str(), it->second.c_str());
+        }
+        fprintf(fp, "#define P8X_%-20s %s\n", "BPP", attr(*project, "bpp").c_str());
+        fprintf(fp, "#define P8X_%-20s %s\n", "SPRITES", attr(*project, "sprites").c_str());
+        if (!attributes["memory_model"].empty())
+            fprintf(fp, "#define P8X_MEMORY_MODEL_%s\n", upper(attributes["memory_model"]).c_str());
+    }
+    finish(fp, guard + "_DEFINES_H");
+
+    fp = create(prefix + "_tiles.h", guard + "_TILES_H");
+    if (fp != NULL) {
+        for (size_t i = 0; i < tiles.size(); i++) {
+            fprintf(fp, "#define %-24s %d\n", tiles[i].define.c_str(), tiles[i].packed);
+        }
+        fprintf(fp, "\n");
+        for (size_t i = 0; i < tiles.size(); i++) {
+            const std::string &d = tiles[i].define;
+            if (d.size() > 3 && d.compare(d.size() - 3, 3, "_00") == 0) {
+                fprintf(fp, "#define %-24s (GPU_TILES_RAM + %d)\n", (d + "_OFS").c_str(), tiles[i].packed * tiles[i].width * tiles[i].height);
+            }
+        }
+        fprintf(fp, "\n#define P8X_TILES_COUNT          %d\n", (int) tiles.size() - removed);
+    }
+    finish(fp, guard + "_TILES_H");
+
+    fp = create(prefix + "_tiledata.h", guard + "_TILEDATA_H");
+    if (fp != NULL && !tiles.empty()) {
+        fprintf(fp, "static const unsigned long long %s_tiledata[%d][%d] = {\n", name.c_str(), (int) tiles.size() - removed, tiles[0].height);
+        for (size_t i = 0; i < tiles.size(); i++) {
+            if (tiles[i].twin != -1)
+                continue;
+            fprintf(fp, "    { //%s\n", tiles[i].name.c_str());
+            for (size_t j = 0; j < tiles[i].rows.size(); j++) {
+                fprintf(fp, "        0x%016llXULL,\n", tiles[i].rows[j]);
+            }
+            fprintf(fp, "    },\n");
+        }
+        fprintf(fp, "};\n");
+    }
+    finish(fp, guard + "_TILEDATA_H");
+
+    fp = create(prefix + "_prototypes.h", guard + "_PROTOTYPES_H");
+    if (fp != NULL) {
+        for (size_t i = 0; i < prototypes.size(); i++) {
+            fprintf(fp, "%s\n", prototypes[i].c_str());
+        }
+    }
+    finish(fp, guard + "_PROTOTYPES_H");
+
+    fp = fopen((prefix + ".manifest").c_str(), "w");
+    if (fp != NULL) {
+        fprintf(fp, "project=%s\n", fileName);
+        fprintf(fp, "memory_model=%s\n", attributes["memory_model"].c_str());
+        fprintf(fp, "cflags=%s\n", attributes["CFLAGS"].c_str());
+        fprintf(fp, "tiles=%d\n", (int) tiles.size() - removed);
+        for (size_t i = 0; i < gpuUnits.size(); i++) {
+            fprintf(fp, "gpu=%s%s\n", dir.c_str(), gpuUnits[i].c_str());
+        }
+        for (size_t i = 0; i < cpuUnits.size(); i++) {
+            fprintf(fp, "cpu=%s%s\n", dir.c_str(), cpuUnits[i].c_str());
+        }
+        fclose(fp);
+    } else {
+        perror((prefix + ".manifest").c_str());
+        errors++;
+    }
+
+    if (!packedPath.empty()) {
+        std::string packed = packProject(text, tiles);
+        fp = fopen(packedPath.c_str(), "wb");
+        if (fp != NULL) {
+            fwrite(packed.data(), 1, packed.size(), fp);
+            fclose(fp);
+        } else {
+            perror(packedPath.c_str());
+            errors++;
+        }
+    }
+
+    if (!flagsPath.empty() && !writeFlags(flagsPath.c_str(), tiles, path.substr(dir.size()))) {
+        errors++;
+    }
+
+    return errors != 0 ? 1 : 0;
+}
@@ -0,0 +1,342 @@
+/*
+ *  P8X Game System - Lode Runner
+ *  Copyright (C) 2010  Alec Bourque
+ *  Copyright (C) 2016  Marco Maccaferri
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Viewer of the profiler stream of a -DPROFILE build (src/profile.cpp).
+ *
+ *      g++ -O2 -o profview profview.cpp
+ *      stty -F /dev/ttyUSB0 115200 raw && cat /dev/ttyUSB0 > capture.bin
+ *      profview [options] capture.bin
+ *
+ *      -m <MHz>        system clock, default 80
+ *      -f <file>       write folded stacks, for flamegraph.pl
+ *      -t <file>       write a trace of every span, chrome://tracing or
+ *                      ui.perfetto.dev show it as a per-frame timeline
+ *
+ *  The report lists calls, total and self time, mean and max of each zone
+ *  per cog, then the frame times against the 60 Hz budget. Records carry
+ *  the low 24 bits of CNT (0.2 s at 80 MHz), they are put back on a single
+ *  time line assuming the stream never lags that much.
+ *
+ *  Zone ids must match the PROFILE_* defines of src/main.cpp. Spans cut by
+ *  lost records (full rings) are dropped and counted. The lowest count of
+ *  stack longs each cog never touched closes the report.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define PROFILE_EXIT        0x80
+#define PROFILE_DROPPED     0x60
+#define PROFILE_STACK       0x70
+#define STACKS              3
+#define PROFILE_SYNC        0xffffffffu
+#define PROFILE_AI_RING     0x10
+#define ZONES               32
+#define RINGS               2
+#define FRAME_ZONE          0
+
+static const char *zoneNames[ZONES] = {
+    "GameFrame", "ProcessPlayer", "ProcessEnemy", "ProcessGold", "ProcessAnimations", "UnpackGameMap", "blitLevelPreview", "RestartLevel",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "Ai", "findPath", NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+};
+static const char *ringNames[RINGS] = { "main", "ai" };
+static const char *stackNames[STACKS] = { "ai", "input", "profiler" };
+
+typedef struct Span {
+    uint8_t zone;
+    int64_t start;
+    int64_t children;       //cycles spent in nested zones
+} Span;
+
+typedef struct ZoneStats {
+    uint64_t calls;
+    int64_t total;
+    int64_t self;
+    int64_t max;
+} ZoneStats;
+
+static std::vector<Span> stacks[RINGS];
+static ZoneStats stats[RINGS][ZONES];
+static std::map<std::string, int64_t> folded;   //stack -> self cycles
+static uint64_t dropped[RINGS];
+static uint64_t broken;                         //spans cut by lost records
+static long stackLeft[STACKS] = { -1, -1, -1 };  //longs never touched, -1 if not reported
+static std::vector<int64_t> frameCycles;
+
+static FILE *trace;
+static bool traceFirst = true;
+static double mhz = 80.0;
+
+static bool validRecord(uint32_t record) {
+    uint8_t event = record & 0xff;
+
+    if (record == PROFILE_SYNC)
+        return true;
+    if ((event & ~1) == PROFILE_DROPPED)
+        return true;
+    if ((event & ~3) == PROFILE_STACK && (event & 3) < STACKS)
+        return true;
+    return (event & 0x60) == 0 && zoneNames[event & 0x1f] != NULL;
+}
+
+static void endSpan(int ring, uint8_t zone, int64_t now) {
+    std::vector<Span> &stack = stacks[ring];
+
+    //entered before the start of the capture or before records were lost
+    if (stack.empty())
+        return;
+    if (stack.back().zone != zone) {
+        //an enter or exit was lost, start over from the next top level zone
+        broken += stack.size() + 1;
+        stack.clear();
+        return;
+    }
+
+    Span span = stack.back();
+    int64_t duration = now - span.start;
+    int64_t self = duration - span.children;
+    ZoneStats *s = &stats[ring][zone];
+
+    s->calls++;
+    s->total += duration;
+    s->self += self;
+    if (duration > s->max) {
+        s->max = duration;
+    }
+
+    std::string key = ringNames[ring];
+    for (size_t i = 0; i < stack.size(); i++) {
+        key += ";";
+        key += zoneNames[stack[i].zone];
+    }
+    folded[key] += self;
+
+    stack.pop_back();
+    if (!stack.empty()) {
+        stack.back().children += duration;
+    }
+    if (ring == 0 && zone == FRAME_ZONE) {
+        frameCycles.push_back(duration);
+    }
+
+    if (trace != NULL) {
+        fprintf(trace, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            traceFirst ? "" : ",", zoneNames[zone], ring, span.start / mhz, duration / mhz);
+        traceFirst = false;
+    }
+}
+
+static void replay(const std::vector<uint8_t> &data) {
+    size_t pos = 0;
+    bool aligned = false;
+    bool started = false;
+    int64_t now = 0;
+    uint64_t skipped = 0;
+
+    //records are 4 bytes, a sync record is the only run of four 0xff: the
+    //stream is read from the first one and again after a garbled record
+    while (pos + 4 <= data.size()) {
+        uint32_t record = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | ((uint32_t) data[pos + 3] << 24);
+
+        if (!aligned || !validRecord(record)) {
+            if (aligned) {
+                aligned = false;
+                for (int r = 0; r < RINGS; r++) {
+                    broken += stacks[r].size();
+                    stacks[r].clear();
+                }
+            }
+            if (record == PROFILE_SYNC) {
+                aligned = true;
+                pos += 4;
+            } else {
+                skipped++;
+                pos++;
+            }
+            continue;
+        }
+        pos += 4;
+
+        uint8_t event = record & 0xff;
+        if (record == PROFILE_SYNC)
+            continue;
+        if ((event & ~1) == PROFILE_DROPPED) {
+            int ring = event & 1;
+            dropped[ring] += record >> 8;
+            broken += stacks[ring].size();
+            stacks[ring].clear();
+            continue;
+        }
+        if ((event & ~3) == PROFILE_STACK) {
+            long left = record >> 8;
+            if (stackLeft[event & 3] < 0 || left < stackLeft[event & 3])
+                stackLeft[event & 3] = left;
+            continue;
+        }
+
+        //closest time to the last record with the same low 24 bits
+        int32_t delta = (int32_t) (((record >> 8) - (uint32_t) now) << 8) >> 8;
+        if (!started) {
+            now = record >> 8;
+            started = true;
+        } else if (delta > 0) {
+            now += delta;
+        }
+        int64_t time = now + (delta < 0 ? delta : 0);
+
+        int ring = (event & PROFILE_AI_RING) ? 1 : 0;
+        uint8_t zone = event & 0x1f;
+        if (event & PROFILE_EXIT) {
+            endSpan(ring, zone, time);
+        } else {
+            Span span = { zone, time, 0 };
+            stacks[ring].push_back(span);
+        }
+    }
+
+    if (skipped != 0) {
+        printf("%llu bytes skipped to find the records\n\n", (unsigned long long) skipped);
+    }
+}
+
+static void report() {
+    printf("cog  zone                  calls     total ms      self ms    mean us     max us\n");
+    for (int r = 0; r < RINGS; r++) {
+        for (int z = 0; z < ZONES; z++) {
+            const ZoneStats *s = &stats[r][z];
+
+            if (s->calls == 0)
+                continue;
+            printf("%-4s %-18s %9llu %12.2f %12.2f %10.1f %10.1f\n", ringNames[r], zoneNames[z],
+                (unsigned long long) s->calls, s->total / (mhz * 1000), s->self / (mhz * 1000),
+                s->total / mhz / s->calls, s->max / mhz);
+        }
+    }
+
+    if (!frameCycles.empty()) {
+        int64_t budget = (int64_t) (mhz * 1000000 / 60);
+        int64_t total = 0, max = 0;
+        size_t over = 0;
+
+        for (size_t i = 0; i < frameCycles.size(); i++) {
+            total += frameCycles[i];
+            if (frameCycles[i] > max)
+                max = frameCycles[i];
+            if (frameCycles[i] > budget)
+                over++;
+        }
+        printf("\n%zu frames, mean %.1f us, max %.1f us, %.1f%% of the 60 Hz budget on average, %zu over budget\n",
+            frameCycles.size(), total / mhz / frameCycles.size(), max / mhz,
+            100.0 * total / frameCycles.size() / budget, over);
+    }
+
+    if (dropped[0] != 0 || dropped[1] != 0 || broken != 0) {
+        printf("\nrecords lost: main %llu, ai %llu, spans dropped %llu\n", (unsigned long long) dropped[0],
+            (unsigned long long) dropped[1], (unsigned long long) broken);
+    }
+
+    bool first = true;
+    for (int s = 0; s < STACKS; s++) {
+        if (stackLeft[s] < 0 || stackLeft[s] == 0xffff)
+            continue;
+        printf("%sstack %s: %ld longs never touched\n", first ? "\n" : "", stackNames[s], stackLeft[s]);
+        first = false;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *input = NULL;
+    const char *foldedPath = NULL;
+    const char *tracePath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            mhz = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            foldedPath = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (argv[i][0] != '-' && input == NULL) {
+            input = argv[i];
+        } else {
+            input = NULL;
+            break;
+        }
+    }
+    if (input == NULL || mhz <= 0) {
+        fprintf(stderr, "usage: %s [-m MHz] [-f folded.txt] [-t trace.json] capture.bin\n", argv[0]);
+        return 2;
+    }
+
+    FILE *fp = fopen(input, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: can't open %s\n", argv[0], input);
+        return 2;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(fp);
+
+    if (tracePath != NULL) {
+        trace = fopen(tracePath, "w");
+        if (trace == NULL) {
+            fprintf(stderr, "%s: can't create %s\n", argv[0], tracePath);
+            return 2;
+        }
+        fprintf(trace, "{\"traceEvents\":[");
+        fprintf(trace, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main cog\"}},");
+        fprintf(trace, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"ai cog\"}}");
+        traceFirst = false;
+    }
+
+    replay(data);
+    report();
+
+    if (trace != NULL) {
+        fprintf(trace, "\n]}\n");
+        fclose(trace);
+    }
+
+    if (foldedPath != NULL) {
+        FILE *out = fopen(foldedPath, "w");
+        if (out == NULL) {
+            fprintf(stderr, "%s: can't create %s\n", argv[0], foldedPath);
+            return 2;
+        }
+        for (std::map<std::string, int64_t>::const_iterator i = folded.begin(); i != folded.end(); ++i) {
+            fprintf(out, "%s %lld\n", i->first.c_str(), (long long) i->second);
+        }
+        fclose(out);
+    }
+
+    return 0;
+}